@@ -1,11 +1,13 @@
 #include "tui.h"
 #include "eval.h"
+#include "book.h"
 #include "board.h"
 #include "policy.h"
 #include "movegen.h"
 #include "datagen.h"
 #include "searcher.h"
 #include "constants.h"
+#include "tablebase.h"
 
 #include <csignal>
 
@@ -39,14 +41,39 @@ int main(int argc, char* argv[]) {
 
     vector<u64> posHistory;
 
+    // The position before the last move, and the go command
+    // of a ponder search to continue with on a ponderhit
+    Board       ponderParent{};
+    Move        ponderReply = Move::null();
+    vector<u64> ponderHistory;
+    string      ponderGo;
+
     bool doUci      = false;
     bool uciMinimal = false;
 
+    // Positions in the book are played without a search
+    Book            book;
+    bool            bookRandom = true;
+    std::mt19937_64 bookEngine(std::random_device{}());
+
     board.reset();
 
     const auto exists            = [&](const string& sub) { return command.find(" " + sub + " ") != string::npos; };
     const auto index             = [&](const string& sub) { return findIndexOf(tokens, sub); };
     const auto getValueFollowing = [&](const string& value, const i64 defaultValue) { return exists(value) ? std::stoll(tokens[index(value) + 1]) : defaultValue; };
+    const auto perftParams       = [&]() {
+        return PerftParameters(getValueFollowing("hash", 0), getValueFollowing("threads", std::max<u32>(std::thread::hardware_concurrency(), 1)), getValueFollowing("split", DEFAULT_PERFT_SPLIT_PLY),
+                               index("verify") != -1, getValueFollowing("--max-depth", 0), getValueFollowing("--time-budget", 0), index("--json") != -1);
+    };
+
+    // Paths may contain spaces, <empty> or no value gives an empty path
+    const auto getPathValue = [&]() {
+        string path;
+        if (const i32 valueIdx = index("value"); valueIdx != -1)
+            for (usize idx = valueIdx + 1; idx < tokens.size(); idx++)
+                path += (path.empty() ? "" : " ") + tokens[idx];
+        return path == "<empty>" ? "" : path;
+    };
 
     // *********** ./Chaos <ARGS> ************
     if (argc > 1) {
@@ -56,12 +83,42 @@ int main(int argc, char* argv[]) {
         for (int i = 0; i < argc; i++)
             args[i] = argv[i];
 
+        // Allow named arguments (e.g. "hash 64") to be read like UCI tokens
+        command = " ";
+        for (const string& arg : args)
+            command += arg + " ";
+        tokens = split(command, ' ');
+
         if (args[1] == "bench")
             searcher.bench(argc > 2 ? std::stoi(argv[2]) : 7);
+        else if (args[1] == "prefetchbench")
+            searcher.prefetchBench(argc > 2 ? std::stoull(argv[2]) : 100'000, argc > 3 ? std::stoull(argv[3]) : 1024);
+        else if (args[1] == "matebench") {
+            searcher.tree.setGraph(argc > 2 && args[2] == "graph");
+            searcher.mateBench();
+        }
         else if (args[1] == "perft")
-            Movegen::perft(board, argc > 2 ? std::stoi(argv[2]) : 5, false);
+            Movegen::perft(board, argc > 2 ? std::stoi(argv[2]) : 5, false, perftParams());
         else if (args[1] == "bulk")
-            Movegen::perft(board, argc > 2 ? std::stoi(argv[2]) : 6, true);
+            Movegen::perft(board, argc > 2 ? std::stoi(argv[2]) : 6, true, perftParams());
+        else if (args[1] == "perftsuite" && argc > 2) {
+            if (!Movegen::perftSuite(args[2], perftParams()))
+                return 1;
+        }
+        else if (args[1] == "tbgen" && argc > 2) {
+            Tablebases tablebases;
+            if (!tablebases.generate(args[2], argc > 3 ? std::stoi(argv[3]) : 1))
+                return 1;
+        }
+        else if (args[1] == "tbbench") {
+            tablebase::bench(argc > 2 ? std::stoi(argv[2]) : 1, searcher.tree.tablebases);
+            searcher.tablebaseBench();
+        }
+        else if (args[1] == "netbench") {
+            const vector<Board> boards = Searcher::benchPositions();
+            benchValueNetworks(boards);
+            benchPolicyNetworks(boards);
+        }
         else if (args[1] == "datagen") {
             static std::atomic<bool> stopDatagen{ false };
             std::signal(SIGINT, [](int) { stopDatagen.store(true); });
@@ -92,6 +149,15 @@ int main(int argc, char* argv[]) {
         Stopwatch<std::chrono::milliseconds> commandTime;
         if (command.empty())
             continue;
+
+        if (command == "ponderhit") {
+            searcher.ponderhit();
+            if (ponderGo.empty())
+                continue;
+            command = ponderGo;
+            ponderGo.clear();
+        }
+
         tokens = split(command, ' ');
 
         // ************   UCI   ************
@@ -110,6 +176,20 @@ int main(int argc, char* argv[]) {
             cout << "option name MultiPV type spin default 1 min 1 max 255" << endl;
             cout << "option name UCI_Chess960 type check default false" << endl;
             cout << "option name SearchMode type string default full" << endl;
+            cout << "option name Ponder type check default false" << endl;
+            cout << "option name GraphSearch type check default false" << endl;
+            cout << "option name ProgressiveWidening type check default false" << endl;
+            cout << "option name Prefetch type check default true" << endl;
+            cout << "option name MateHash type spin default " << DEFAULT_MATE_HASH << " min 1 max 1048576" << endl;
+            cout << "option name MatePolicyPriors type check default false" << endl;
+            cout << "option name ExperienceFile type string default <empty>" << endl;
+            cout << "option name ExperienceSize type spin default " << DEFAULT_EXPERIENCE_SIZE << " min 1 max 1048576" << endl;
+            cout << "option name ExperienceMinVisits type spin default " << DEFAULT_EXPERIENCE_MIN_VISITS << " min 1 max 1000000000" << endl;
+            cout << "option name Book type string default <empty>" << endl;
+            cout << "option name BookRandom type check default true" << endl;
+            cout << "option name TablebasePath type string default <empty>" << endl;
+            cout << "option name ValueNet type string default " << valueNetworkName() << endl;
+            cout << "option name PolicyNet type string default " << policyNetworkName() << endl;
             #ifdef TUNE
             printTuneUCI();
             #endif
@@ -130,10 +210,13 @@ int main(int argc, char* argv[]) {
             else if (tokens[1] == "fen")
                 board.loadFromFEN(command.substr(13));
 
-            posHistory = { board.zobrist };
+            posHistory  = { board.zobrist };
+            ponderReply = Move::null();
 
             if (const i32 idx = findIndexOf(tokens, "moves"); idx != -1) {
                 for (i32 mIdx = idx + 1; mIdx < tokens.size(); mIdx++) {
+                    ponderParent = board;
+                    ponderReply  = Move(tokens[mIdx], board);
                     board.move(tokens[mIdx]);
                     posHistory.push_back(board.zobrist);
                 }
@@ -150,18 +233,101 @@ int main(int argc, char* argv[]) {
             const i64 winc = getValueFollowing("winc", 0);
             const i64 binc = getValueFollowing("binc", 0);
 
-            const bool mate = exists("mate");
+            const usize movesToGo = getValueFollowing("movestogo", 0);
+
+            // A bare "mate" searches for a mate of any length
+            usize mate = 0;
+            if (const i32 mateIdx = index("mate"); mateIdx != -1) {
+                const string length    = static_cast<usize>(mateIdx) + 1 < tokens.size() ? tokens[mateIdx + 1] : "";
+                const bool   hasLength = !length.empty() && std::ranges::all_of(length, [](const char c) { return c >= '0' && c <= '9'; });
+                mate                   = hasLength ? std::max<usize>(std::stoull(length), 1) : MATE_MAX;
+            }
 
             const i64 time = board.stm == WHITE ? wtime : btime;
             const i64 inc  = board.stm == WHITE ? winc : binc;
 
-            const SearchParameters params(posHistory, true, doUci, uciMinimal);
-            const SearchLimits     limits(commandTime, mate, depth, nodes, mtime, time, inc);
-            searcher.start(board, params, limits);
+            // Analysis, ponder and mate searches always search
+            const bool useBook  = book.isOpen() && searcher.searchMode == FULL_SEARCH && mate == 0 && index("infinite") == -1 && index("ponder") == -1;
+            const Move bookMove = useBook ? book.pick(board, bookEngine, bookRandom) : Move::null();
+
+            if (!bookMove.isNull()) {
+                if (doUci)
+                    cout << "info string book move" << endl;
+                cout << "bestmove " << bookMove << endl;
+            }
+            else if (index("ponder") != -1 && searcher.searchMode == FULL_SEARCH) {
+                // Searched as a normal go if the reply is played
+                ponderGo = command;
+                ponderGo.erase(ponderGo.find(" ponder"), 7);
+
+                ponderHistory = posHistory;
+                if (!ponderReply.isNull())
+                    ponderHistory.pop_back();
+
+                const SearchParameters params(ponderHistory, true, doUci, uciMinimal);
+                const SearchLimits     limits(commandTime, 0, 0, 0, 0, 0, 0);
+                searcher.ponder(ponderReply.isNull() ? board : ponderParent, ponderReply, params, limits);
+            }
+            else {
+                const SearchParameters params(posHistory, true, doUci, uciMinimal);
+                const SearchLimits     limits(commandTime, mate, depth, nodes, mtime, time, inc, movesToGo);
+                searcher.start(board, params, limits);
+            }
         }
         else if (tokens[0] == "setoption") {
             if (tokens[2] == "Hash")
                 searcher.setHash(hash = getValueFollowing("value", DEFAULT_HASH));
+            else if (tokens[2] == "GraphSearch")
+                searcher.tree.setGraph(tokens[findIndexOf(tokens, "value") + 1] == "true");
+            else if (tokens[2] == "ProgressiveWidening")
+                searcher.tree.widening = tokens[findIndexOf(tokens, "value") + 1] == "true";
+            else if (tokens[2] == "Prefetch")
+                searcher.tree.prefetch = tokens[findIndexOf(tokens, "value") + 1] == "true";
+            else if (tokens[2] == "MateHash")
+                searcher.setMateHash(getValueFollowing("value", DEFAULT_MATE_HASH));
+            else if (tokens[2] == "MatePolicyPriors")
+                searcher.matePolicyPriors = tokens[findIndexOf(tokens, "value") + 1] == "true";
+            else if (tokens[2] == "ExperienceFile")
+                searcher.setExperienceFile(getPathValue());
+            else if (tokens[2] == "ExperienceSize")
+                searcher.setExperienceSize(getValueFollowing("value", DEFAULT_EXPERIENCE_SIZE));
+            else if (tokens[2] == "ExperienceMinVisits")
+                searcher.tree.experience.minVisits = std::max<u64>(getValueFollowing("value", DEFAULT_EXPERIENCE_MIN_VISITS), 1);
+            else if (tokens[2] == "Book") {
+                const string path = getPathValue();
+                if (path.empty())
+                    book.close();
+                else if (!book.open(path))
+                    cout << "info string could not open book " << path << endl;
+            }
+            else if (tokens[2] == "BookRandom")
+                bookRandom = tokens[findIndexOf(tokens, "value") + 1] == "true";
+            else if (tokens[2] == "TablebasePath") {
+                const string path = getPathValue();
+                searcher.stop();
+                if (path.empty())
+                    searcher.tree.tablebases.close();
+                else
+                    cout << "info string loaded " << searcher.tree.tablebases.load(path) << " tables from " << path << endl;
+            }
+            else if (tokens[2] == "ValueNet" || tokens[2] == "PolicyNet") {
+                // The architecture, then the file unless it is the embedded network
+                const bool   isValue = tokens[2] == "ValueNet";
+                const string value   = getPathValue();
+                const usize  split   = std::min(value.find(' '), value.size());
+                const string arch    = value.substr(0, split);
+                const string path    = value.substr(std::min(split + 1, value.size()));
+
+                searcher.stop();
+                if (isValue ? setValueNetwork(arch, path) : setPolicyNetwork(arch, path))
+                    searcher.reset();
+                else {
+                    cout << "info string could not use " << value << ", architectures are";
+                    for (const string& name : isValue ? valueArchitectures() : policyArchitectures())
+                        cout << " " << name;
+                    cout << endl;
+                }
+            }
             else if (tokens[2] == "Minimal")
                 uciMinimal = tokens[findIndexOf(tokens, "value") + 1] == "true";
             else if (tokens[2] == "MultiPV")
@@ -174,6 +340,8 @@ int main(int argc, char* argv[]) {
                     searcher.searchMode = POLICY_ONLY;
                 else if (value == "value")
                     searcher.searchMode = VALUE_ONLY;
+                else if (value == "mate")
+                    searcher.searchMode = PROOF_NUMBER;
                 else
                     searcher.searchMode = FULL_SEARCH;
             }
@@ -193,6 +361,14 @@ int main(int argc, char* argv[]) {
             cout << board << endl;
         else if (command == "tree")
             searcher.launchInteractiveTree();
+        else if (tokens[0] == "savetree" && tokens.size() > 1) {
+            searcher.stop();
+            searcher.saveTree(tokens[1]);
+        }
+        else if (tokens[0] == "loadtree" && tokens.size() > 1) {
+            searcher.stop();
+            searcher.loadTree(tokens[1]);
+        }
         else if (tokens[0] == "move")
             board.move(tokens[1]);
         else if (command == "eval")
@@ -200,11 +376,11 @@ int main(int argc, char* argv[]) {
         else if (command == "policy")
             searcher.printRootPolicy(board);
         else if (tokens[0] == "perft")
-            Movegen::perft(board, std::stoi(tokens[1]), false);
+            Movegen::perft(board, std::stoi(tokens[1]), false, perftParams());
         else if (tokens[0] == "bulk")
-            Movegen::perft(board, std::stoi(tokens[1]), true);
+            Movegen::perft(board, std::stoi(tokens[1]), true, perftParams());
         else if (tokens[0] == "perftsuite")
-            Movegen::perftSuite(tokens[1]);
+            Movegen::perftSuite(tokens[1], perftParams());
         else if (command == "tui")
             launchTui();
 
@@ -236,4 +412,4 @@ int main(int argc, char* argv[]) {
     }
 
     return 0;
-}
+}
\ No newline at end of file
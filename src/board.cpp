@@ -120,6 +120,11 @@ void Board::resetZobrist() {
 
     zobrist ^= hashCastling();
     zobrist ^= EP_ZTABLE[epSquare];
+
+    // Keep the hash consistent with Board::move, which
+    // toggles the stm key every ply
+    if (stm == BLACK)
+        zobrist ^= STM_ZHASH;
 }
 
 // Updates checkers and pinners
@@ -181,7 +186,9 @@ void Board::setCastlingRights(Color c, Square sq, bool value) { castling[castleI
 
 void Board::unsetCastlingRights(Color c) { castling[castleIndex(c, true)] = castling[castleIndex(c, false)] = NO_SQUARE; }
 
-u64 Board::hashCastling() const {
+u64 Board::hashCastling() const { return hashCastling(castling); }
+
+u64 Board::hashCastling(const array<Square, 4>& rights) {
     constexpr usize blackQ = 0b1;
     constexpr usize blackK = 0b10;
     constexpr usize whiteQ = 0b100;
@@ -189,13 +196,13 @@ u64 Board::hashCastling() const {
 
     usize flags = 0;
 
-    if (castling[castleIndex(WHITE, true)])
+    if (rights[castleIndex(WHITE, true)])
         flags |= whiteK;
-    if (castling[castleIndex(WHITE, false)])
+    if (rights[castleIndex(WHITE, false)])
         flags |= whiteQ;
-    if (castling[castleIndex(BLACK, true)])
+    if (rights[castleIndex(BLACK, true)])
         flags |= blackK;
-    if (castling[castleIndex(BLACK, false)])
+    if (rights[castleIndex(BLACK, false)])
         flags |= blackQ;
 
     return CASTLING_ZTABLE[flags];
@@ -352,6 +359,22 @@ void Board::loadFromFEN(string fen) {
     updateCheckPinAttack();
 }
 
+void Board::loadFromBitboards(const array<u64, 6>& pieceBBs, const array<u64, 2>& colorBBs, const Color sideToMove) {
+    byPieces = pieceBBs;
+    byColor  = colorBBs;
+    stm      = sideToMove;
+
+    castling.fill(NO_SQUARE);
+    epSquare = NO_SQUARE;
+
+    halfMoveClock = 0;
+    fullMoveClock = 1;
+
+    resetMailbox();
+    resetZobrist();
+    updateCheckPinAttack();
+}
+
 string Board::fen() const {
     std::ostringstream ss;
 
@@ -519,6 +542,60 @@ void Board::move(Move m) {
     updateCheckPinAttack();
 }
 
+// Follows move(), updating only the key
+u64 Board::keyAfter(const Move m) const {
+    const Square    from = m.from();
+    const Square    to   = m.to();
+    const MoveType  mt   = m.typeOf();
+    const PieceType pt   = getPiece(from);
+    const PieceType toPT = isCapture(m) ? getPiece(to) : NO_PIECE_TYPE;
+
+    u64    key     = zobrist ^ hashCastling() ^ EP_ZTABLE[epSquare] ^ STM_ZHASH;
+    Square childEp = NO_SQUARE;
+
+    key ^= PIECE_ZTABLE[stm][pt][from];
+    if (toPT != NO_PIECE_TYPE)
+        key ^= PIECE_ZTABLE[~stm][toPT][to];
+
+    switch (mt) {
+    case STANDARD_MOVE:
+        key ^= PIECE_ZTABLE[stm][pt][to];
+        if (pt == PAWN && (to + 16 == from || to - 16 == from)
+            && (pieces(~stm, PAWN) & (shift<EAST>((1ULL << to) & ~MASK_FILE[FILE_H]) | shift<WEST>((1ULL << to) & ~MASK_FILE[FILE_A]))))
+            childEp = Square(stm == WHITE ? from + NORTH : from + SOUTH);
+        break;
+    case EN_PASSANT:
+        key ^= PIECE_ZTABLE[~stm][PAWN][to + (stm == WHITE ? SOUTH : NORTH)];
+        key ^= PIECE_ZTABLE[stm][pt][to];
+        break;
+    case CASTLE:
+        key ^= PIECE_ZTABLE[stm][ROOK][to];
+        key ^= PIECE_ZTABLE[stm][KING][KING_CASTLE_END_SQ[castleIndex(stm, from < to)]];
+        key ^= PIECE_ZTABLE[stm][ROOK][ROOK_CASTLE_END_SQ[castleIndex(stm, from < to)]];
+        break;
+    case PROMOTION:
+        key ^= PIECE_ZTABLE[stm][m.promo()][to];
+        break;
+    }
+
+    // Neither king moved when a rook did or was captured
+    array<Square, 4> rights = castling;
+    if (pt == ROOK) {
+        const bool kingside = from > ctzll(pieces(stm, KING));
+        if (from == castleSq(stm, kingside))
+            rights[castleIndex(stm, kingside)] = NO_SQUARE;
+    }
+    else if (pt == KING)
+        rights[castleIndex(stm, true)] = rights[castleIndex(stm, false)] = NO_SQUARE;
+    if (toPT == ROOK) {
+        const bool kingside = to > ctzll(pieces(~stm, KING));
+        if (to == castleSq(~stm, kingside))
+            rights[castleIndex(~stm, kingside)] = NO_SQUARE;
+    }
+
+    return key ^ hashCastling(rights) ^ EP_ZTABLE[childEp];
+}
+
 bool Board::canCastle(Color c) const { return castleSq(c, true) != NO_SQUARE || castleSq(c, false) != NO_SQUARE; }
 bool Board::canCastle(Color c, bool kingside) const { return castleSq(c, kingside) != NO_SQUARE; }
 
@@ -47,7 +47,8 @@ struct Board {
     void setCastlingRights(Color c, Square sq, bool value);
     void unsetCastlingRights(Color c);
 
-    u64 hashCastling() const;
+    u64        hashCastling() const;
+    static u64 hashCastling(const array<Square, 4>& rights);
 
    public:
     static void fillZobristTable();
@@ -68,6 +69,8 @@ struct Board {
 
     void   loadFromFEN(string fen);
     string fen() const;
+    // Set up a position from bitboards, with no castling rights or en passant square
+    void loadFromBitboards(const array<u64, 6>& pieceBBs, const array<u64, 2>& colorBBs, Color sideToMove);
 
     char getPieceAt(int i) const;
 
@@ -80,6 +83,9 @@ struct Board {
     void move(Move m);
     void move(string str);
 
+    // The zobrist key the board has after the move, without making it
+    u64 keyAfter(Move m) const;
+
     bool canCastle(Color c) const;
     bool canCastle(Color c, bool kingside) const;
 
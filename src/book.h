@@ -0,0 +1,39 @@
+#pragma once
+
+#include "move.h"
+#include "board.h"
+#include "types.h"
+#include "mappedfile.h"
+
+#include <random>
+
+// The key of a position in polyglot books. It uses polyglot's own random
+// numbers, so it is computed from the board when a book is probed rather
+// than kept up to date alongside the search's zobrist key
+u64 polyglotKey(const Board& board);
+
+struct BookMove {
+    Move move;
+    u16  weight;
+};
+
+// A polyglot opening book, mapped into memory. Entries are sorted by key,
+// so the moves of a position are found with a binary search
+class Book {
+    MappedFile file;
+    usize      entries;
+
+   public:
+    Book() { entries = 0; }
+
+    bool open(const string& path);
+    void close();
+    bool isOpen() const { return entries != 0; }
+
+    // Every legal move the book has for the position
+    vector<BookMove> probe(const Board& board) const;
+
+    // Returns a move picked at random by the book's weights, or the
+    // highest weighted one, or Move::null() if the position is not in the book
+    Move pick(const Board& board, std::mt19937_64& engine, bool random) const;
+};
\ No newline at end of file
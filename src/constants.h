@@ -8,6 +8,14 @@
 constexpr usize UCI_REPORTING_FREQUENCY = 1000;
 constexpr usize MOVE_OVERHEAD           = 20;
 
+// Moves the clock is split over when the GUI gives no movestogo
+constexpr i64 DEFAULT_MOVES_TO_GO = 20;
+// Search iterations between time manager updates
+constexpr u64 TIME_MANAGER_INTERVAL = 256;
+
+// Longest mate searched for when no length is given
+constexpr usize MATE_MAX = 64;
+
 constexpr u64 INF_U64 = std::numeric_limits<u64>::max();
 constexpr u64 INF_U32 = std::numeric_limits<u32>::max();
 constexpr int INF_I16 = std::numeric_limits<i16>::max();
@@ -17,4 +25,8 @@ constexpr u64 LIGHT_SQ_BB = 0x55AA55AA55AA55AA;
 constexpr u64 DARK_SQ_BB  = 0xAA55AA55AA55AA55;
 
 // ************ DEFAULT UCI OPTIONS ************
-constexpr usize DEFAULT_HASH = 16;
\ No newline at end of file
+constexpr usize DEFAULT_HASH      = 16;
+constexpr usize DEFAULT_MATE_HASH = 16;
+
+constexpr usize DEFAULT_EXPERIENCE_SIZE       = 16;
+constexpr u64   DEFAULT_EXPERIENCE_MIN_VISITS = 10'000;
\ No newline at end of file
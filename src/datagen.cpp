@@ -1,9 +1,12 @@
 #include "datagen.h"
 
+#include "book.h"
+#include "eval.h"
 #include "board.h"
 #include "searcher.h"
 #include "stopwatch.h"
 #include "movegen.h"
+#include "policy.h"
 
 #include <filesystem>
 #include <fstream>
@@ -116,8 +119,8 @@ struct MontyFormatMove {
     VisitDistribution visits;
 
     explicit MontyFormatMove(const Searcher& searcher, const Move m) {
-        const Node& root     = searcher.tree.root();
-        const u64   firstIdx = root.firstChild.load().index();
+        const Searcher::Node& root     = searcher.tree.root();
+        const u64             firstIdx = root.firstChild.load().index();
 
         visits.reserve(root.numChildren);
 
@@ -125,8 +128,8 @@ struct MontyFormatMove {
         rootQ    = root.getScore();
 
         for (u64 idx = firstIdx; idx < firstIdx + root.numChildren; idx++) {
-            const Node& node = searcher.tree.activeTree()[idx];
-            const u16   move = asMontyMove(searcher.rootPos, node.move);
+            const Searcher::Node& node = searcher.tree.activeTree()[idx];
+            const u16             move = asMontyMove(searcher.rootPos, node.move);
 
             visits.emplace_back(move, node.visits);
         }
@@ -241,7 +244,7 @@ string makeFileName() {
     return "data-" + fmt::format("{:04}-{:02}-{:02}", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday) + "-" + randomStr + ".chaosdata";
 }
 
-void runThread(const u64 nodes, Board& board, std::mutex& boardMutex, atomic<u64>& positions, atomic<u64>& games, const atomic<bool>& stop) {
+void runThread(const u64 nodes, const Book& book, Board& board, std::mutex& boardMutex, atomic<u64>& positions, atomic<u64>& games, const atomic<bool>& stop) {
     string filePath = "./data/" + makeFileName();
 
     if (!std::filesystem::is_directory("./data/"))
@@ -259,7 +262,7 @@ void runThread(const u64 nodes, Board& board, std::mutex& boardMutex, atomic<u64
     Stopwatch<std::chrono::milliseconds> stopwatch;
     vector<u64>                          posHistory;
     const SearchParameters               params(posHistory, false, false, true);
-    const SearchLimits                   limits(stopwatch, false, 0, nodes, 0, 0, 0);
+    const SearchLimits                   limits(stopwatch, 0, 0, nodes, 0, 0, 0);
 
     usize localPositions = 0;
 
@@ -275,6 +278,24 @@ mainLoop:
 
         posHistory = { board.zobrist };
 
+        // With a book, games open with a weighted random line from it
+        // in place of the random moves, unless the book has no moves here
+        if (book.isOpen()) {
+            while (!board.isGameOver(posHistory)) {
+                const Move m = book.pick(board, engine, true);
+                if (m.isNull())
+                    break;
+                lk.lock();
+                board.move(m);
+                lk.unlock();
+                posHistory.push_back(board.zobrist);
+            }
+            if (board.isGameOver(posHistory))
+                goto mainLoop;
+            if (posHistory.size() > 1)
+                randomMoves = 0;
+        }
+
         for (usize i = 0; i < randomMoves; i++) {
             lk.lock();
             makeRandomMove(board);
@@ -289,10 +310,10 @@ mainLoop:
         bool isFirstMove = true;
 
         while (!board.isGameOver(posHistory)) {
-            Node& root       = searcher.tree.root();
-            root             = Node();
-            searcher.rootPos = board;
-            const Move m     = searcher.search(params, limits);
+            Searcher::Node& root = searcher.tree.root();
+            root                 = Searcher::Node();
+            searcher.rootPos     = board;
+            const Move m         = searcher.search(params, limits);
             assert(!m.isNull());
 
             if (isFirstMove && std::abs(wdlToCP(root.getScore())) > datagen::MAX_STARTPOS_SCORE)
@@ -350,9 +371,30 @@ void datagen::run(const string& params, std::atomic<bool>& stopFlag) {
         return tokens[idx];
     };
 
-    const usize threadCount  = parseSuffixedNum(getValueFollowing("threads", 1));
-    const u64   numPositions = parseSuffixedNum(getValueFollowing("positions", 100'000'000));
-    const u64   nodes        = parseSuffixedNum(getValueFollowing("nodes", 1'000));
+    const usize  threadCount  = parseSuffixedNum(getValueFollowing("threads", 1));
+    const u64    numPositions = parseSuffixedNum(getValueFollowing("positions", 100'000'000));
+    const u64    nodes        = parseSuffixedNum(getValueFollowing("nodes", 1'000));
+    const string bookPath     = getValueFollowing("book", "");
+    // A smaller network gives more games per hour at low node counts
+    const string valueArch    = getValueFollowing("valuearch", valueArchitectures()[0]);
+    const string valuePath    = getValueFollowing("valuenet", "");
+    const string policyArch   = getValueFollowing("policyarch", policyArchitectures()[0]);
+    const string policyPath   = getValueFollowing("policynet", "");
+
+    Book book;
+    if (!bookPath.empty() && !book.open(bookPath)) {
+        cout << "ERROR: COULD NOT OPEN BOOK " << bookPath << endl;
+        return;
+    }
+
+    if (!setValueNetwork(valueArch, valuePath)) {
+        cout << "ERROR: COULD NOT LOAD " << valueArch << " VALUE NETWORK " << valuePath << endl;
+        return;
+    }
+    if (!setPolicyNetwork(policyArch, policyPath)) {
+        cout << "ERROR: COULD NOT LOAD " << policyArch << " POLICY NETWORK " << policyPath << endl;
+        return;
+    }
 
     Stopwatch<std::chrono::milliseconds> time;
     vector<std::thread>                  threads;
@@ -408,7 +450,7 @@ void datagen::run(const string& params, std::atomic<bool>& stopFlag) {
         b.reset();
 
     for (usize i = 0; i < threadCount; i++)
-        threads.emplace_back(runThread, nodes, std::ref(boards[i]), std::ref(boardMutexes[i]), std::ref(positions[i]), std::ref(games[i]), std::cref(stopFlag));
+        threads.emplace_back(runThread, nodes, std::cref(book), std::ref(boards[i]), std::ref(boardMutexes[i]), std::ref(positions[i]), std::ref(games[i]), std::cref(stopFlag));
 
     cursor::hide();
 
@@ -540,11 +582,11 @@ void datagen::genFens(const string& params) {
         const Stopwatch<std::chrono::milliseconds> stopwatch;
         vector<u64>                                posHistory;
         const SearchParameters                     params(posHistory, false, false, true);
-        const SearchLimits                         limits(stopwatch, false, 0, datagen::GENFENS_VERIF_NODES, 0, 0, 0);
+        const SearchLimits                         limits(stopwatch, 0, 0, datagen::GENFENS_VERIF_NODES, 0, 0, 0);
 
         static Searcher searcher{};
         searcher.rootPos     = board;
-        searcher.tree.root() = Node();
+        searcher.tree.root() = Searcher::Node();
         searcher.search(params, limits);
 
         return std::abs(wdlToCP(searcher.tree.root().getScore())) <= MAX_STARTPOS_SCORE;
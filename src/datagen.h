@@ -18,6 +18,12 @@ constexpr i32 MAX_STARTPOS_SCORE = 400;
 
 constexpr u64 GENFENS_VERIF_NODES = 2'000;
 
+// Stops a search early once the root visit distribution has converged,
+// when the KL divergence gained per visit falls below the threshold
+constexpr bool  KLD_GAIN_STOP      = false;
+constexpr float KLD_GAIN_THRESHOLD = 0.000002;
+constexpr u64   KLD_GAIN_INTERVAL  = 512;
+
 constexpr u64 POSITION_COUNT_BUFFER = 1024;
 
 void run(const string& params, std::atomic<bool>& stopFlag);
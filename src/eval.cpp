@@ -1,4 +1,7 @@
 #include "eval.h"
+#include "movegen.h"
+#include "stopwatch.h"
+#include "networkfile.h"
 
 #ifdef _MSC_VER
     #define MSVC
@@ -23,68 +26,164 @@ constexpr usize ALIGNMENT = 64;
 constexpr usize ALIGNMENT = 32;
 #endif
 
-struct ValueAccumulator {
-    alignas(ALIGNMENT) array<i16, HL_SIZE_V> underlying;
+template<usize HL, int ACTIVATION>
+struct ValueNN;
 
-    explicit ValueAccumulator(const Board& board);
+// The active inputs of a position, indexed from the side to move's view with
+// the files mirrored so the side to move's king is always on the queenside
+struct ValueFeatures {
+    array<u16, 32> indices;
+    usize          count;
 
-    const i16& operator[](const usize& idx) const { return underlying[idx]; }
-    i16&       operator[](const usize& idx) { return underlying[idx]; }
-};
+    explicit ValueFeatures(const Board& board) : ValueFeatures(board, board.stm) {}
+    // From either side's view, mirrored by that side's king
+    ValueFeatures(const Board& board, Color perspective);
 
-struct ValueNN {
-    alignas(ALIGNMENT) array<i16, HL_SIZE_V * 768> weightsToHL;
-    alignas(ALIGNMENT) array<i16, HL_SIZE_V> hiddenLayerBias;
-    alignas(ALIGNMENT) array<i16, HL_SIZE_V> weightsToOut;
-    i16 outputBias;
-
-    static i16 ReLU(const i16 x);
-    static i16 CReLU(const i16 x);
-
-    i32 vectorizedSCReLU(const ValueAccumulator& accum) const;
+    // One bit for each input
+    array<u64, 12> inputs() const;
+    // The same read straight off the bitboards, one word for each side and piece
+    static array<u64, 12> inputs(const Board& board, Color perspective);
 
+    static int   flip(const Board& board, const Color perspective);
     static usize feature(const Color stm, const Color pieceColor, const PieceType piece, const Square square);
 };
 
-const ValueNN nn = *reinterpret_cast<const ValueNN*>(gEVALData);
+// The inputs a position has that a shared set of inputs doesn't, and the ones it lacks
+// A set held by two of three positions has at most 48 inputs
+struct ValueDelta {
+    array<u16, 32> added;
+    array<u16, 48> removed;
+    usize          addedCount;
+    usize          removedCount;
 
-ValueAccumulator::ValueAccumulator(const Board& board) {
+    ValueDelta() : addedCount(0), removedCount(0) {}
+};
+
+ValueFeatures::ValueFeatures(const Board& board, const Color perspective) {
     u64 whitePieces = board.pieces(WHITE);
     u64 blackPieces = board.pieces(BLACK);
 
-    underlying = nn.hiddenLayerBias;
+    const int flip = ValueFeatures::flip(board, perspective);
 
-    const Square stmKing = getLSB(board.pieces(board.stm, KING));
-    const int    flip    = (fileOf(stmKing) >= FILE_E) * 0b000111;
+    count = 0;
 
     while (whitePieces) {
         const auto rawSq = popLSB(whitePieces);
         const auto sq    = static_cast<Square>(rawSq ^ flip);
 
-        const usize feature = ValueNN::feature(board.stm, WHITE, board.getPiece(rawSq), sq);
-
-        for (usize i = 0; i < HL_SIZE_V; i++)
-            underlying[i] += nn.weightsToHL[feature * HL_SIZE_V + i];
+        indices[count++] = feature(perspective, WHITE, board.getPiece(rawSq), sq);
     }
 
     while (blackPieces) {
         const auto rawSq = popLSB(blackPieces);
         const auto sq    = static_cast<Square>(rawSq ^ flip);
 
-        const usize feature = ValueNN::feature(board.stm, BLACK, board.getPiece(rawSq), sq);
+        indices[count++] = feature(perspective, BLACK, board.getPiece(rawSq), sq);
+    }
+}
+
+array<u64, 12> ValueFeatures::inputs() const {
+    array<u64, 12> bits{};
+    for (usize f = 0; f < count; f++)
+        bits[indices[f] / 64] |= 1ULL << (indices[f] % 64);
+    return bits;
+}
+
+array<u64, 12> ValueFeatures::inputs(const Board& board, const Color perspective) {
+    const bool     mirror = flip(board, perspective);
+    array<u64, 12> bits;
+
+    for (const Color color : { perspective, ~perspective }) {
+        for (usize piece = 0; piece < 6; piece++) {
+            u64 bb = board.pieces(color, static_cast<PieceType>(piece));
+            if (mirror) {
+                bb = ((bb >> 1) & 0x5555555555555555ULL) | ((bb & 0x5555555555555555ULL) << 1);
+                bb = ((bb >> 2) & 0x3333333333333333ULL) | ((bb & 0x3333333333333333ULL) << 2);
+                bb = ((bb >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((bb & 0x0F0F0F0F0F0F0F0FULL) << 4);
+            }
+            if (perspective == BLACK)
+                bb = __builtin_bswap64(bb);
+
+            bits[(color != perspective) * 6 + piece] = bb;
+        }
+    }
+
+    return bits;
+}
+
+// Mirrors the files of every square when the perspective's king is on the kingside
+int ValueFeatures::flip(const Board& board, const Color perspective) { return (fileOf(getLSB(board.pieces(perspective, KING))) >= FILE_E) * 0b000111; }
+
+// Finds the input feature
+usize ValueFeatures::feature(const Color stm, const Color pieceColor, const PieceType piece, const Square square) {
+    const bool enemy       = stm != pieceColor;
+    const int  squareIndex = (stm == BLACK) ? flipRank(square) : static_cast<int>(square);
+
+    return enemy * 64 * 6 + piece * 64 + squareIndex;
+}
+
+// Number of inputs that are in one set but not the other
+usize changedInputs(const array<u64, 12>& a, const array<u64, 12>& b) {
+    usize changed = 0;
+    for (usize w = 0; w < a.size(); w++)
+        changed += popcount(a[w] ^ b[w]);
+    return changed;
+}
+
+template<usize HL>
+struct ValueAccumulator {
+    alignas(ALIGNMENT) array<i16, HL> underlying;
+
+    template<int ACTIVATION>
+    ValueAccumulator(const ValueNN<HL, ACTIVATION>& nn, const ValueFeatures& features);
+
+    const i16& operator[](const usize& idx) const { return underlying[idx]; }
+    i16&       operator[](const usize& idx) { return underlying[idx]; }
+};
+
+template<usize HL, int ACTIVATION>
+struct ValueNN {
+    alignas(ALIGNMENT) array<i16, HL * 768> weightsToHL;
+    alignas(ALIGNMENT) array<i16, HL> hiddenLayerBias;
+    alignas(ALIGNMENT) array<i16, HL> weightsToOut;
+    i16 outputBias;
 
-        for (usize i = 0; i < HL_SIZE_V; i++)
-            underlying[i] += nn.weightsToHL[feature * HL_SIZE_V + i];
+    static i16 ReLU(const i16 x);
+    static i16 CReLU(const i16 x);
+
+    // The hidden layer's output before dequantization
+    i32  vectorizedForward(const i16* accum) const;
+    // Evaluates positions given by their deltas from a shared accumulator
+    void vectorizedForwardBatch(const i16* shared, const ValueDelta* deltas, usize count, i32* out) const;
+
+    i32  scaleOutput(i32 eval) const;
+    i32  evaluate(const Board& board) const;
+    i32  evaluate(const Board& board, ValueCache::Perspective& cache) const;
+    void evaluateBatch(std::span<const Board> boards, std::span<i32> evals) const;
+};
+
+template<usize HL>
+template<int ACTIVATION>
+ValueAccumulator<HL>::ValueAccumulator(const ValueNN<HL, ACTIVATION>& nn, const ValueFeatures& features) {
+    underlying = nn.hiddenLayerBias;
+
+    for (usize f = 0; f < features.count; f++) {
+        const usize feature = features.indices[f];
+
+        for (usize i = 0; i < HL; i++)
+            underlying[i] += nn.weightsToHL[feature * HL + i];
     }
 }
 
-i16 ValueNN::ReLU(const i16 x) {
+template<usize HL, int ACTIVATION>
+i16 ValueNN<HL, ACTIVATION>::ReLU(const i16 x) {
     if (x < 0)
         return 0;
     return x;
 }
 
-i16 ValueNN::CReLU(const i16 x) {
+template<usize HL, int ACTIVATION>
+i16 ValueNN<HL, ACTIVATION>::CReLU(const i16 x) {
     if (x < 0)
         return 0;
     if (x > QA_V)
@@ -100,24 +199,32 @@ i16 ValueNN::CReLU(const i16 x) {
         #pragma message("Using AVX512 NN inference")
 using Vectori16 = __m512i;
 using Vectori32 = __m512i;
+// Vector registers the ISA has
+constexpr usize REGISTER_COUNT = 32;
         #define set1_epi16 _mm512_set1_epi16
         #define load_epi16(x) _mm512_load_si512(reinterpret_cast<const Vectori16*>(x))
         #define min_epi16 _mm512_min_epi16
         #define max_epi16 _mm512_max_epi16
         #define madd_epi16 _mm512_madd_epi16
         #define mullo_epi16 _mm512_mullo_epi16
+        #define add_epi16 _mm512_add_epi16
+        #define sub_epi16 _mm512_sub_epi16
         #define add_epi32 _mm512_add_epi32
         #define reduce_epi32 _mm512_reduce_add_epi32
     #elif defined(__AVX2__)
         #pragma message("Using AVX2 NN inference")
 using Vectori16 = __m256i;
 using Vectori32 = __m256i;
+// Vector registers the ISA has
+constexpr usize REGISTER_COUNT = 16;
         #define set1_epi16 _mm256_set1_epi16
         #define load_epi16(x) _mm256_load_si256(reinterpret_cast<const Vectori16*>(x))
         #define min_epi16 _mm256_min_epi16
         #define max_epi16 _mm256_max_epi16
         #define madd_epi16 _mm256_madd_epi16
         #define mullo_epi16 _mm256_mullo_epi16
+        #define add_epi16 _mm256_add_epi16
+        #define sub_epi16 _mm256_sub_epi16
         #define add_epi32 _mm256_add_epi32
         #define reduce_epi32 \
             [](Vectori32 vec) { \
@@ -135,6 +242,8 @@ using Vectori32 = __m256i;
         #pragma message("Using NEON NN inference")
 using Vectori16 = int16x8_t;
 using Vectori32 = int32x4_t;
+// Vector registers the ISA has
+constexpr usize REGISTER_COUNT = 32;
         #define set1_epi16 vdupq_n_s16
         #define load_epi16(x) vld1q_s16(reinterpret_cast<const i16*>(x))
         #define min_epi16 vminq_s16
@@ -146,6 +255,8 @@ using Vectori32 = int32x4_t;
                 return vpaddq_s32(low, high); \
             }
         #define mullo_epi16 vmulq_s16
+        #define add_epi16 vaddq_s16
+        #define sub_epi16 vsubq_s16
         #define add_epi32 vaddq_s32
         #define reduce_epi32 vaddvq_s32
     #else
@@ -153,12 +264,16 @@ using Vectori32 = int32x4_t;
 // Assumes SSE support here
 using Vectori16 = __m128i;
 using Vectori32 = __m128i;
+// Vector registers the ISA has
+constexpr usize REGISTER_COUNT = 16;
         #define set1_epi16 _mm_set1_epi16
         #define load_epi16(x) _mm_load_si128(reinterpret_cast<const Vectori16*>(x))
         #define min_epi16 _mm_min_epi16
         #define max_epi16 _mm_max_epi16
         #define madd_epi16 _mm_madd_epi16
         #define mullo_epi16 _mm_mullo_epi16
+        #define add_epi16 _mm_add_epi16
+        #define sub_epi16 _mm_sub_epi16
         #define add_epi32 _mm_add_epi32
         #define reduce_epi32 \
             [](Vectori32 vec) { \
@@ -169,77 +284,492 @@ using Vectori32 = __m128i;
                 return _mm_cvtsi128_si32(vec); \
             }
     #endif
-i32 ValueNN::vectorizedSCReLU(const ValueAccumulator& accum) const {
-    constexpr usize VECTOR_SIZE = sizeof(Vectori16) / sizeof(i16);
-    static_assert(HL_SIZE_V % VECTOR_SIZE == 0, "HL size must be divisible by the native register size of your CPU for vectorization to work");
+// Applies the activation to a register of accumulator values and multiplies by the output weights
+template<int ACTIVATION>
+inline Vectori32 activate(const Vectori16 accumValues, const Vectori16 weights) {
     const Vectori16 VEC_QA_V = set1_epi16(QA_V);
     const Vectori16 VEC_ZERO = set1_epi16(0);
 
+    if constexpr (ACTIVATION == ::ReLU)
+        return madd_epi16(max_epi16(accumValues, VEC_ZERO), weights);
+
+    // Clamp values
+    const Vectori16 clamped = min_epi16(VEC_QA_V, max_epi16(accumValues, VEC_ZERO));
+
+    if constexpr (ACTIVATION == ::CReLU)
+        return madd_epi16(clamped, weights);
+
+    // SCReLU it
+    return madd_epi16(clamped, mullo_epi16(clamped, weights));
+}
+
+template<usize HL, int ACTIVATION>
+i32 ValueNN<HL, ACTIVATION>::vectorizedForward(const i16* accum) const {
+    constexpr usize VECTOR_SIZE = sizeof(Vectori16) / sizeof(i16);
+    static_assert(HL % VECTOR_SIZE == 0, "HL size must be divisible by the native register size of your CPU for vectorization to work");
+
     Vectori32 valueAccumulator{};
 
     #pragma unroll
-    for (usize i = 0; i < HL_SIZE_V; i += VECTOR_SIZE) {
+    for (usize i = 0; i < HL; i += VECTOR_SIZE) {
         // Load accumulator
         const Vectori16 accumValues = load_epi16(&accum[i]);
 
-        // Clamp values
-        const Vectori16 clamped = min_epi16(VEC_QA_V, max_epi16(accumValues, VEC_ZERO));
-
         // Load weights
         const Vectori16 weights = load_epi16(reinterpret_cast<const Vectori16*>(&weightsToOut[i]));
 
-        // SCReLU it
-        const Vectori32 activated = madd_epi16(clamped, mullo_epi16(clamped, weights));
-
-        valueAccumulator = add_epi32(valueAccumulator, activated);
+        valueAccumulator = add_epi32(valueAccumulator, activate<ACTIVATION>(accumValues, weights));
     }
 
     return reduce_epi32(valueAccumulator);
 }
+
+// Positions are evaluated a slice of the hidden layer at a time. The slices of the shared
+// accumulator and of the output weights are loaded into registers once for the whole batch,
+// then each position's slice stays in registers from the shared one through the output
+// layer, so its accumulator is never written out and only the rows it changes are loaded
+template<usize HL, int ACTIVATION>
+void ValueNN<HL, ACTIVATION>::vectorizedForwardBatch(const i16* shared, const ValueDelta* deltas, const usize count, i32* out) const {
+    constexpr usize VECTOR_SIZE = sizeof(Vectori16) / sizeof(i16);
+    // The shared accumulator, output weights and a position's accumulator each take a slice of registers
+    constexpr usize REGISTERS  = std::min<usize>(REGISTER_COUNT / 4, HL / VECTOR_SIZE);
+    constexpr usize SLICE_SIZE = VECTOR_SIZE * REGISTERS;
+    static_assert(HL % SLICE_SIZE == 0, "HL size must be divisible by the batch slice size");
+
+    // Each slice's output is reduced into the position's i32 sum
+    std::fill(out, out + count, 0);
+
+    for (usize slice = 0; slice < HL; slice += SLICE_SIZE) {
+        Vectori16 sharedValues[REGISTERS];
+        Vectori16 weights[REGISTERS];
+
+        #pragma unroll
+        for (usize r = 0; r < REGISTERS; r++) {
+            sharedValues[r] = load_epi16(&shared[slice + r * VECTOR_SIZE]);
+            weights[r]      = load_epi16(&weightsToOut[slice + r * VECTOR_SIZE]);
+        }
+
+        for (usize p = 0; p < count; p++) {
+            const ValueDelta& delta = deltas[p];
+            Vectori16         accumValues[REGISTERS];
+
+            #pragma unroll
+            for (usize r = 0; r < REGISTERS; r++)
+                accumValues[r] = sharedValues[r];
+
+            for (usize f = 0; f < delta.addedCount; f++) {
+                const i16* row = &weightsToHL[delta.added[f] * HL + slice];
+
+                #pragma unroll
+                for (usize r = 0; r < REGISTERS; r++)
+                    accumValues[r] = add_epi16(accumValues[r], load_epi16(row + r * VECTOR_SIZE));
+            }
+
+            for (usize f = 0; f < delta.removedCount; f++) {
+                const i16* row = &weightsToHL[delta.removed[f] * HL + slice];
+
+                #pragma unroll
+                for (usize r = 0; r < REGISTERS; r++)
+                    accumValues[r] = sub_epi16(accumValues[r], load_epi16(row + r * VECTOR_SIZE));
+            }
+
+            Vectori32 valueAccumulator{};
+
+            #pragma unroll
+            for (usize r = 0; r < REGISTERS; r++)
+                valueAccumulator = add_epi32(valueAccumulator, activate<ACTIVATION>(accumValues[r], weights[r]));
+
+            out[p] += reduce_epi32(valueAccumulator);
+        }
+    }
+}
 #else
     #pragma message("Using compiler optimized NN inference")
-i32 NN::vectorizedSCReLU(const ValueAccumulator& accum) const {
+template<usize HL, int ACTIVATION>
+i32 ValueNN<HL, ACTIVATION>::vectorizedForward(const i16* accum) const {
     i32 res = 0;
 
     #pragma unroll
-    for (usize i = 0; i < HL_SIZE_V; i++) {
-        res += (i32) SCReLU(accum[i]) * weightsToOut[bucket][i];
+    for (usize i = 0; i < HL; i++) {
+        if constexpr (ACTIVATION == ::ReLU)
+            res += ReLU(accum[i]) * weightsToOut[i];
+        if constexpr (ACTIVATION == ::CReLU)
+            res += CReLU(accum[i]) * weightsToOut[i];
+        if constexpr (ACTIVATION == ::SCReLU)
+            res += CReLU(accum[i]) * static_cast<i16>(CReLU(accum[i]) * weightsToOut[i]);
     }
     return res;
 }
+
+template<usize HL, int ACTIVATION>
+void ValueNN<HL, ACTIVATION>::vectorizedForwardBatch(const i16* shared, const ValueDelta* deltas, const usize count, i32* out) const {
+    array<i16, HL> accum;
+    for (usize p = 0; p < count; p++) {
+        std::copy(shared, shared + HL, accum.begin());
+        for (usize f = 0; f < deltas[p].addedCount; f++)
+            for (usize i = 0; i < HL; i++)
+                accum[i] += weightsToHL[deltas[p].added[f] * HL + i];
+        for (usize f = 0; f < deltas[p].removedCount; f++)
+            for (usize i = 0; i < HL; i++)
+                accum[i] -= weightsToHL[deltas[p].removed[f] * HL + i];
+        out[p] = vectorizedForward(accum.data());
+    }
+}
 #endif
 
-// Finds the input feature
-usize ValueNN::feature(const Color stm, const Color pieceColor, const PieceType piece, const Square square) {
-    const bool enemy       = stm != pieceColor;
-    const int  squareIndex = (stm == BLACK) ? flipRank(square) : static_cast<int>(square);
+// Dequantize the hidden layer's output, then apply the output bias and scale the result
+template<usize HL, int ACTIVATION>
+i32 ValueNN<HL, ACTIVATION>::scaleOutput(i32 eval) const {
+    if constexpr (ACTIVATION == ::SCReLU)
+        eval /= QA_V;
 
-    return enemy * 64 * 6 + piece * 64 + squareIndex;
+    eval += outputBias;
+
+    return (eval * EVAL_SCALE_V) / (QA_V * QB_V);
 }
 
-i32 evaluate(const Board& board) {
-    const ValueAccumulator accum(board);
-    i32                    eval = 0;
+template<usize HL, int ACTIVATION>
+i32 ValueNN<HL, ACTIVATION>::evaluate(const Board& board) const {
+    const ValueAccumulator<HL> accum(*this, ValueFeatures(board));
+
+    return scaleOutput(vectorizedForward(accum.underlying.data()));
+}
 
-    if constexpr (ACTIVATION_V != ::SCReLU) {
-        for (usize i = 0; i < HL_SIZE_V; i++) {
-            // First HL_SIZE_V weights are for STM
-            if constexpr (ACTIVATION_V == ::ReLU)
-                eval += nn.ReLU(accum[i]) * nn.weightsToOut[i];
-            if constexpr (ACTIVATION_V == ::CReLU)
-                eval += nn.CReLU(accum[i]) * nn.weightsToOut[i];
+template<usize HL, int ACTIVATION>
+i32 ValueNN<HL, ACTIVATION>::evaluate(const Board& board, ValueCache::Perspective& cache) const {
+    const ValueFeatures  features(board);
+    const array<u64, 12> inputs  = features.inputs();
+    const usize          changed = cache.network == this ? changedInputs(inputs, cache.inputs) : features.count;
+
+    i16* accum = cache.accumulator.data();
+
+    // Starting over touches one row per piece, so it is
+    // used when at least as many rows would have changed
+    if (changed >= features.count) {
+        std::copy(hiddenLayerBias.begin(), hiddenLayerBias.end(), accum);
+
+        for (usize f = 0; f < features.count; f++)
+            for (usize i = 0; i < HL; i++)
+                accum[i] += weightsToHL[features.indices[f] * HL + i];
+    }
+    else {
+        for (usize w = 0; w < inputs.size(); w++) {
+            u64 added   = inputs[w] & ~cache.inputs[w];
+            u64 removed = cache.inputs[w] & ~inputs[w];
+
+            while (added) {
+                const usize feature = w * 64 + popLSB(added);
+                for (usize i = 0; i < HL; i++)
+                    accum[i] += weightsToHL[feature * HL + i];
+            }
+
+            while (removed) {
+                const usize feature = w * 64 + popLSB(removed);
+                for (usize i = 0; i < HL; i++)
+                    accum[i] -= weightsToHL[feature * HL + i];
+            }
         }
     }
-    else
-        eval = nn.vectorizedSCReLU(accum);
 
+    cache.inputs  = inputs;
+    cache.network = this;
 
-    // Dequantization
-    if constexpr (ACTIVATION_V == ::SCReLU)
-        eval /= QA_V;
+    return scaleOutput(vectorizedForward(accum));
+}
 
-    eval += nn.outputBias;
+template<usize HL, int ACTIVATION>
+void ValueNN<HL, ACTIVATION>::evaluateBatch(const std::span<const Board> boards, const std::span<i32> evals) const {
+    assert(boards.size() == evals.size());
+
+    if (boards.empty())
+        return;
+
+    // The inputs held by most of the first, middle and last boards are summed once.
+    // For siblings those are the parent's, so each board only adds and removes the
+    // rows its move changed
+    const array<u64, 12> first  = ValueFeatures::inputs(boards.front(), boards.front().stm);
+    const array<u64, 12> middle = ValueFeatures::inputs(boards[boards.size() / 2], boards[boards.size() / 2].stm);
+    const array<u64, 12> last   = ValueFeatures::inputs(boards.back(), boards.back().stm);
+    array<u64, 12>       shared;
+    usize                deltaRows   = 0;
+    usize                featureRows = 0;
+    for (usize w = 0; w < shared.size(); w++) {
+        shared[w] = (first[w] & middle[w]) | (first[w] & last[w]) | (middle[w] & last[w]);
+        for (const u64 position : { first[w], middle[w], last[w] }) {
+            deltaRows += popcount(position ^ shared[w]);
+            featureRows += popcount(position);
+        }
+    }
 
-    // Apply output bias and scale the result
-    return (eval * EVAL_SCALE_V) / (QA_V * QB_V);
+    // Each board then also pays for its input bits, which only boards a few
+    // rows apart like siblings make up for. Others start from the bias
+    const bool related = deltaRows * 2 < featureRows;
+
+    alignas(ALIGNMENT) array<i16, HL> sharedAccum = hiddenLayerBias;
+    vector<ValueDelta>                deltas(boards.size());
+
+    if (related) {
+        for (usize w = 0; w < shared.size(); w++) {
+            u64 bits = shared[w];
+            while (bits) {
+                const usize feature = w * 64 + popLSB(bits);
+                for (usize i = 0; i < HL; i++)
+                    sharedAccum[i] += weightsToHL[feature * HL + i];
+            }
+        }
+
+        for (usize idx = 0; idx < boards.size(); idx++) {
+            const array<u64, 12> inputs = ValueFeatures::inputs(boards[idx], boards[idx].stm);
+            ValueDelta&          delta  = deltas[idx];
+            for (usize w = 0; w < shared.size(); w++) {
+                u64 added   = inputs[w] & ~shared[w];
+                u64 removed = shared[w] & ~inputs[w];
+                while (added)
+                    delta.added[delta.addedCount++] = w * 64 + popLSB(added);
+                while (removed)
+                    delta.removed[delta.removedCount++] = w * 64 + popLSB(removed);
+            }
+        }
+    }
+    else {
+        for (usize idx = 0; idx < boards.size(); idx++) {
+            const ValueFeatures features(boards[idx]);
+            std::copy(features.indices.begin(), features.indices.begin() + features.count, deltas[idx].added.begin());
+            deltas[idx].addedCount = features.count;
+        }
+    }
+
+    vectorizedForwardBatch(sharedAccum.data(), deltas.data(), deltas.size(), evals.data());
+
+    for (i32& eval : evals)
+        eval = scaleOutput(eval);
+}
+
+// A compiled in architecture, called through the type erased network it is used with
+struct ValueArchitecture {
+    const char* name;
+    usize       size;
+    i32 (*evaluate)(const void* network, const Board& board);
+    i32 (*evaluateCached)(const void* network, const Board& board, ValueCache::Perspective& cache);
+    void (*evaluateBatch)(const void* network, std::span<const Board> boards, std::span<i32> evals);
+    // Points the cache at the network's input layer
+    void (*bind)(const void* network, ValueCache& cache);
+};
+
+template<usize HL, int ACTIVATION>
+constexpr ValueArchitecture makeValueArchitecture(const char* name) {
+    using Network = ValueNN<HL, ACTIVATION>;
+    static_assert(HL <= HL_SIZE_V, "The value cache is sized for the embedded network's hidden layer");
+    return { name,
+             sizeof(Network),
+             [](const void* network, const Board& board) { return static_cast<const Network*>(network)->evaluate(board); },
+             [](const void* network, const Board& board, ValueCache::Perspective& cache) { return static_cast<const Network*>(network)->evaluate(board, cache); },
+             [](const void* network, const std::span<const Board> boards, const std::span<i32> evals) { static_cast<const Network*>(network)->evaluateBatch(boards, evals); },
+             [](const void* network, ValueCache& cache) {
+                 const Network& nn = *static_cast<const Network*>(network);
+                 cache.weights     = nn.weightsToHL.data();
+                 cache.bias        = nn.hiddenLayerBias.data();
+                 cache.size        = HL;
+             } };
+}
+
+// The embedded network's architecture comes first
+constexpr array VALUE_ARCHITECTURES = { makeValueArchitecture<HL_SIZE_V, ACTIVATION_V>("1024screlu"),
+                                        makeValueArchitecture<512, SCReLU>("512screlu"),
+                                        makeValueArchitecture<256, SCReLU>("256screlu"),
+                                        makeValueArchitecture<128, CReLU>("128crelu") };
+
+const ValueNN<HL_SIZE_V, ACTIVATION_V> nn = *reinterpret_cast<const ValueNN<HL_SIZE_V, ACTIVATION_V>*>(gEVALData);
+
+// The network in use, changed only while no search is running
+NetworkFile              loadedValueNetwork;
+const ValueArchitecture* activeValueArchitecture = &VALUE_ARCHITECTURES[0];
+const void*              activeValueNetwork      = &nn;
+string                   activeValueName         = VALUE_ARCHITECTURES[0].name;
+
+i32 evaluate(const Board& board) { return activeValueArchitecture->evaluate(activeValueNetwork, board); }
+
+void evaluateBatch(const std::span<const Board> boards, const std::span<i32> evals) {
+    activeValueArchitecture->evaluateBatch(activeValueNetwork, boards, evals);
+
+    for (usize idx = 0; idx < boards.size(); idx++)
+        assert(evals[idx] == evaluate(boards[idx]));
+}
+
+// A cache left by another network is started over
+void useActiveNetwork(ValueCache& cache) {
+    if (cache.architecture == activeValueArchitecture)
+        return;
+    cache.perspectives[WHITE].network = nullptr;
+    cache.perspectives[BLACK].network = nullptr;
+    cache.architecture                = activeValueArchitecture;
+    cache.architecture->bind(activeValueNetwork, cache);
+}
+
+i32 evaluate(const Board& board, ValueCache& cache) {
+    useActiveNetwork(cache);
+
+    const i32 eval = activeValueArchitecture->evaluateCached(activeValueNetwork, board, cache.perspectives[board.stm]);
+    assert(eval == evaluate(board));
+    return eval;
+}
+
+bool ValueCache::prime(const Board& board) {
+    useActiveNetwork(*this);
+
+    const Color          children = ~board.stm;
+    const ValueFeatures  features(board, children);
+    const array<u64, 12> target = features.inputs();
+    Perspective&         cached = perspectives[children];
+
+    // Children would reach their accumulator from the cached one in fewer rows
+    if (cached.network == activeValueNetwork && changedInputs(target, cached.inputs) < features.count)
+        return false;
+
+    cached.inputs  = target;
+    cached.network = activeValueNetwork;
+
+    primed      = &cached;
+    perspective = children;
+    flip        = ValueFeatures::flip(board, children);
+
+    std::copy(bias, bias + size, cached.accumulator.begin());
+    return true;
+}
+
+void ValueCache::addPiece(const Color color, const PieceType piece, const Square square) {
+    const usize feature = ValueFeatures::feature(perspective, color, piece, static_cast<Square>(square ^ flip));
+
+    for (usize i = 0; i < size; i++)
+        primed->accumulator[i] += weights[feature * size + i];
+}
+
+void ValueCache::prefetch(const Board& board, const Move m) const {
+    // Nothing has been evaluated through the cache yet
+    if (architecture != activeValueArchitecture)
+        return;
+
+    // The mover's king doesn't mirror the other side's view
+    const Color     view  = ~board.stm;
+    const int       flip  = ValueFeatures::flip(board, view);
+    const Square    from  = m.from();
+    const Square    to    = m.to();
+    const PieceType piece = board.getPiece(from);
+
+    const auto row = [&](const Color color, const PieceType pt, const Square sq) {
+        const i16* start = &weights[ValueFeatures::feature(view, color, pt, static_cast<Square>(sq ^ flip)) * size];
+        for (usize offset = 0; offset < size * sizeof(i16); offset += 64)
+            __builtin_prefetch(reinterpret_cast<const char*>(start) + offset);
+    };
+
+    row(board.stm, piece, from);
+    switch (m.typeOf()) {
+    case STANDARD_MOVE:
+        row(board.stm, piece, to);
+        if (board.getPiece(to) != NO_PIECE_TYPE)
+            row(~board.stm, board.getPiece(to), to);
+        break;
+    case EN_PASSANT:
+        row(board.stm, PAWN, to);
+        row(~board.stm, PAWN, static_cast<Square>(to + (board.stm == WHITE ? SOUTH : NORTH)));
+        break;
+    case CASTLE:
+        row(board.stm, ROOK, to);
+        row(board.stm, KING, KING_CASTLE_END_SQ[castleIndex(board.stm, from < to)]);
+        row(board.stm, ROOK, ROOK_CASTLE_END_SQ[castleIndex(board.stm, from < to)]);
+        break;
+    case PROMOTION:
+        row(board.stm, m.promo(), to);
+        if (board.getPiece(to) != NO_PIECE_TYPE)
+            row(~board.stm, board.getPiece(to), to);
+        break;
+    }
+}
+
+vector<string> valueArchitectures() {
+    vector<string> names;
+    for (const ValueArchitecture& arch : VALUE_ARCHITECTURES)
+        names.emplace_back(arch.name);
+    return names;
+}
+
+bool setValueNetwork(const string& arch, const string& path) {
+    const auto found = std::ranges::find_if(VALUE_ARCHITECTURES, [&](const ValueArchitecture& a) { return arch == a.name; });
+    if (found == VALUE_ARCHITECTURES.end())
+        return false;
+
+    if (path.empty()) {
+        if (found != VALUE_ARCHITECTURES.begin())
+            return false;
+        activeValueNetwork = &nn;
+        loadedValueNetwork.close();
+    }
+    else {
+        if (!loadedValueNetwork.load(path, found->size))
+            return false;
+        activeValueNetwork = loadedValueNetwork.data();
+    }
+
+    activeValueArchitecture = &*found;
+    activeValueName         = path.empty() ? arch : arch + " " + path;
+    return true;
+}
+
+string valueNetworkName() { return activeValueName; }
+
+void benchValueNetworks(const std::span<const Board> boards) {
+    constexpr usize REPEATS = 200;
+
+    vector<i32> evals(boards.size());
+
+    // The children of each position, batched the way searchValue evaluates them
+    vector<vector<Board>> siblings(boards.size());
+    usize                 siblingCount = 0;
+    for (usize idx = 0; idx < boards.size(); idx++) {
+        for (const Move m : Movegen::generateMoves(boards[idx])) {
+            siblings[idx].push_back(boards[idx]);
+            siblings[idx].back().move(m);
+        }
+        siblingCount += siblings[idx].size();
+    }
+    vector<i32> siblingEvals(256);
+
+    for (const ValueArchitecture& arch : VALUE_ARCHITECTURES) {
+        // Other architectures run with zeroed weights, which are just as fast
+        NetworkFile zeroed;
+        const void* network = &arch == activeValueArchitecture ? activeValueNetwork : nullptr;
+        if (!network) {
+            zeroed.zero(arch.size);
+            network = zeroed.data();
+        }
+
+        Stopwatch<std::chrono::microseconds> stopwatch;
+        for (usize rep = 0; rep < REPEATS; rep++)
+            for (usize idx = 0; idx < boards.size(); idx++)
+                evals[idx] = arch.evaluate(network, boards[idx]);
+        const u64 singleTime = std::max<u64>(stopwatch.elapsed(), 1);
+
+        stopwatch.reset();
+        for (usize rep = 0; rep < REPEATS; rep++)
+            arch.evaluateBatch(network, boards, evals);
+        const u64 batchTime = std::max<u64>(stopwatch.elapsed(), 1);
+
+        stopwatch.reset();
+        for (usize rep = 0; rep < REPEATS; rep++)
+            for (const vector<Board>& children : siblings)
+                for (usize idx = 0; idx < children.size(); idx++)
+                    siblingEvals[idx] = arch.evaluate(network, children[idx]);
+        const u64 siblingTime = std::max<u64>(stopwatch.elapsed(), 1);
+
+        stopwatch.reset();
+        for (usize rep = 0; rep < REPEATS; rep++)
+            for (const vector<Board>& children : siblings)
+                arch.evaluateBatch(network, children, std::span(siblingEvals).first(children.size()));
+        const u64 siblingBatchTime = std::max<u64>(stopwatch.elapsed(), 1);
+
+        const u64 count        = boards.size() * REPEATS;
+        const u64 siblingTotal = siblingCount * REPEATS;
+        cout << "value " << arch.name << ": " << count * 1'000'000 / singleTime << " evals/s, " << count * 1'000'000 / batchTime << " evals/s batched, " << siblingTotal * 1'000'000 / siblingTime
+             << " evals/s siblings, " << siblingTotal * 1'000'000 / siblingBatchTime << " evals/s siblings batched" << endl;
+    }
 }
\ No newline at end of file
@@ -2,6 +2,8 @@
 
 #include "board.h"
 
+#include <span>
+
 // ************ VALUE NETWORK CONFIG ************
 constexpr i16   QA_V         = 255;
 constexpr i16   QB_V         = 64;
@@ -10,4 +12,68 @@ constexpr usize HL_SIZE_V    = 1024;
 
 constexpr int ACTIVATION_V = SCReLU;
 
+struct ValueArchitecture;
+
+// The value net's accumulators of the last position evaluated through it from each
+// side's view. A position only adds and removes the weight rows that differ from the
+// last one its side to move saw, which for positions close in the tree are a handful.
+// A search carries one down every descent
+struct ValueCache {
+    struct Perspective {
+        // Sized for the largest architecture
+        alignas(64) array<i16, HL_SIZE_V> accumulator;
+        // One bit for each input summed into the accumulator
+        array<u64, 12> inputs;
+        // The network the accumulator belongs to, null while it is empty
+        const void* network;
+    };
+
+    array<Perspective, 2>    perspectives;
+    const ValueArchitecture* architecture;
+    // The network's input layer
+    const i16* weights;
+    const i16* bias;
+    usize      size;
+
+    // The perspective being primed and its mirroring
+    Perspective* primed;
+    Color        perspective;
+    int          flip;
+
+    ValueCache() {
+        perspectives[WHITE].network = nullptr;
+        perspectives[BLACK].network = nullptr;
+        architecture                = nullptr;
+    }
+
+    // Expanding a position primes its opponent's view, which its children are
+    // evaluated from, unless the children are already a few rows away from it.
+    // Returns whether it did, then the caller adds every piece with addPiece so
+    // the rows are streamed alongside its own network's weights for the piece
+    bool prime(const Board& board);
+    void addPiece(Color color, PieceType piece, Square square);
+
+    // Start loading the weight rows of the inputs a move changes for the side
+    // that evaluates the position after it
+    void prefetch(const Board& board, Move m) const;
+};
+
 i32 evaluate(const Board& board);
+// Evaluates through the cache, leaving it holding the position's accumulator
+i32 evaluate(const Board& board, ValueCache& cache);
+// Evaluates every board into the matching slot of evals, faster than
+// evaluating them one at a time when the boards share most of their pieces
+void evaluateBatch(std::span<const Board> boards, std::span<i32> evals);
+
+// Hidden layer sizes and activations compiled in, named like "1024screlu"
+// The embedded network uses HL_SIZE_V and ACTIVATION_V, the others are
+// smaller architectures for faster search such as low node datagen
+vector<string> valueArchitectures();
+// Use the network of the given architecture from the file, or the embedded
+// network when the file is empty. Returns false and keeps the current
+// network if the architecture is unknown or the file doesn't match it
+bool   setValueNetwork(const string& arch, const string& path);
+string valueNetworkName();
+
+// Measures evaluation speed of every value architecture
+void benchValueNetworks(std::span<const Board> boards);
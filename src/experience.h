@@ -0,0 +1,128 @@
+#pragma once
+
+#include "types.h"
+#include "constants.h"
+#include "mappedfile.h"
+
+#include <cstring>
+
+// Positions that gathered many visits in earlier searches, kept in a file
+// that persists across games. A search that reaches one of them uses the
+// stored score in place of the network's, and every search merges its
+// own well visited positions back into the file once it is done
+struct ExperienceEntry {
+    u64   key;
+    u64   visits;
+    float q;
+    u32   padding;
+};
+
+struct ExperienceHeader {
+    array<char, 8> magic;
+    u32            version;
+    u32            padding;
+    u64            entries;
+};
+
+static_assert(sizeof(ExperienceEntry) == 24);
+static_assert(sizeof(ExperienceHeader) == 24);
+
+class ExperienceTable {
+    static constexpr array<char, 8> MAGIC   = { 'C', 'H', 'A', 'O', 'S', 'E', 'X', 'P' };
+    static constexpr u32            VERSION = 1;
+
+    MappedFile       file;
+    ExperienceEntry* table;
+    u64              size;
+
+    u64 index(const u64 key) const { return static_cast<u64>((static_cast<u128>(key) * static_cast<u128>(size)) >> 64); }
+
+   public:
+    // Only positions with at least this many visits are merged into the file
+    u64 minVisits;
+
+    ExperienceTable() {
+        table     = nullptr;
+        size      = 0;
+        minVisits = DEFAULT_EXPERIENCE_MIN_VISITS;
+    }
+
+    bool isOpen() const { return table != nullptr; }
+
+    void close() {
+        file.close();
+        table = nullptr;
+        size  = 0;
+    }
+
+    // Opens the file at the given size, creating it if it does not exist
+    // A file of a different size has its entries rehashed into the new one
+    bool open(const string& path, const usize sizeMB) {
+        close();
+
+        const u64 entries = std::max<u64>(sizeMB * 1024 * 1024 / sizeof(ExperienceEntry), 1);
+
+        vector<ExperienceEntry> previous;
+        if (file.open(path)) {
+            ExperienceHeader header{};
+            if (file.size() >= sizeof(header))
+                std::memcpy(&header, file.data(), sizeof(header));
+
+            // Never overwrite a file that is not an experience file
+            if (header.magic != MAGIC || header.version != VERSION || file.size() != sizeof(header) + header.entries * sizeof(ExperienceEntry)) {
+                file.close();
+                return false;
+            }
+
+            if (header.entries != entries) {
+                const ExperienceEntry* old = reinterpret_cast<const ExperienceEntry*>(file.data() + sizeof(header));
+                for (u64 idx = 0; idx < header.entries; idx++)
+                    if (old[idx].key != 0)
+                        previous.push_back(old[idx]);
+            }
+            file.close();
+        }
+
+        if (!file.create(path, sizeof(ExperienceHeader) + entries * sizeof(ExperienceEntry)))
+            return false;
+
+        table = reinterpret_cast<ExperienceEntry*>(file.data() + sizeof(ExperienceHeader));
+        size  = entries;
+
+        ExperienceHeader header{};
+        std::memcpy(&header, file.data(), sizeof(header));
+        if (header.entries != entries) {
+            header = { MAGIC, VERSION, 0, entries };
+            std::memcpy(file.data(), &header, sizeof(header));
+            std::memset(table, 0, entries * sizeof(ExperienceEntry));
+
+            for (const ExperienceEntry& entry : previous)
+                store(entry.key, entry.visits, entry.q);
+        }
+
+        return true;
+    }
+
+    // Returns the entry for the position, or nullptr if it has none
+    const ExperienceEntry* probe(const u64 key) const {
+        const ExperienceEntry& entry = table[index(key)];
+        return entry.key == key ? &entry : nullptr;
+    }
+
+    void prefetch(const u64 key) const { __builtin_prefetch(&table[index(key)]); }
+
+    // A position replaces its own entry with a search at least as large,
+    // and only displaces another position with more visits than it had
+    void store(const u64 key, const u64 visits, const float q) {
+        ExperienceEntry& entry = table[index(key)];
+        if (key == entry.key ? visits >= entry.visits : visits > entry.visits)
+            entry = { key, visits, q, 0 };
+    }
+
+    u64 occupied() const {
+        u64 count = 0;
+        for (u64 idx = 0; idx < size; idx++)
+            count += table[idx].key != 0;
+        return count;
+    }
+};
\ No newline at end of file
@@ -5,7 +5,8 @@
 #include "types.h"
 #include "tunable.h"
 
-struct ButterflyHistory {
+template<typename Concurrency>
+struct BasicButterflyHistory {
     // Indexed [stm][from][to]
     MultiArray<RelaxedAtomic<i32>, 2, 64, 64> butterfly{};
 
@@ -20,6 +21,6 @@ struct ButterflyHistory {
         const i32 cp    = wdlToCP(wdl);
         auto&     entry = butterfly[stm][m.from()][m.to()];
 
-        entry.getUnderlying() += scaleBonus(entry.load(), cp);
+        Concurrency::add(entry, scaleBonus(entry.load(), cp));
     }
 };
\ No newline at end of file
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "types.h"
+
+#include <fstream>
+#include <iterator>
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+// A file mapped into memory, either read only or writable at a fixed size
+// Without mmap the file is read into memory instead, and a writable
+// file is written back when it is closed
+class MappedFile {
+    char*  data_;
+    usize  size_;
+    bool   writable;
+    string path;
+#ifdef _WIN32
+    vector<char> buffer;
+#endif
+
+   public:
+    MappedFile() {
+        data_    = nullptr;
+        size_    = 0;
+        writable = false;
+    }
+
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&)            = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool isOpen() const { return data_ != nullptr; }
+
+    char*       data() { return data_; }
+    const char* data() const { return data_; }
+    usize       size() const { return size_; }
+
+    // Map an existing file read only
+    bool open(const string& filePath) {
+        close();
+        path     = filePath;
+        writable = false;
+#ifdef _WIN32
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            return false;
+        buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        if (buffer.empty())
+            return false;
+        data_ = buffer.data();
+        size_ = buffer.size();
+#else
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0) {
+            void* mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED) {
+                data_ = static_cast<char*>(mapped);
+                size_ = info.st_size;
+            }
+        }
+        ::close(fd);
+#endif
+        return isOpen();
+    }
+
+    // Map a file for writing, creating it or resizing it to the given size
+    // Existing contents are kept up to the new size, new space is zeroed
+    bool create(const string& filePath, const usize newSize) {
+        close();
+        path     = filePath;
+        writable = true;
+#ifdef _WIN32
+        std::ifstream file(path, std::ios::binary);
+        if (file)
+            buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        buffer.resize(newSize, 0);
+        data_ = buffer.data();
+        size_ = buffer.size();
+#else
+        const int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0)
+            return false;
+
+        if (ftruncate(fd, newSize) == 0) {
+            void* mapped = mmap(nullptr, newSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (mapped != MAP_FAILED) {
+                data_ = static_cast<char*>(mapped);
+                size_ = newSize;
+            }
+        }
+        ::close(fd);
+#endif
+        return isOpen();
+    }
+
+    void close() {
+        if (!isOpen())
+            return;
+#ifdef _WIN32
+        if (writable) {
+            std::ofstream file(path, std::ios::binary | std::ios::trunc);
+            file.write(buffer.data(), buffer.size());
+        }
+        buffer.clear();
+        buffer.shrink_to_fit();
+#else
+        if (writable)
+            msync(data_, size_, MS_SYNC);
+        munmap(data_, size_);
+#endif
+        data_ = nullptr;
+        size_ = 0;
+    }
+};
\ No newline at end of file
@@ -0,0 +1,422 @@
+#include "searcher.h"
+#include "movegen.h"
+#include "policy.h"
+#include "timeman.h"
+
+#include <cmath>
+
+// Depth first proof number search (df-pn) for forced mates
+// The attacker is the side to move at the root and has
+// 2 * mate - 1 plies to deliver checkmate. Every node is
+// stored with the number of plies left, so results of
+// different mate lengths never mix in the table
+// Draws by repetition along the search path are scored as
+// failures for the attacker. A failure found through one may
+// not hold when the node is reached another way, so it is
+// never stored, which keeps the graph history interaction
+// from leaking bad disproofs. Proofs never rely on one
+// Positions of the game before the root are draws when they
+// would occur for the third time, the same as in the full search
+
+// Cost added to a child's initial proof number per
+// nat of surprise of the policy, when priors are enabled
+constexpr float MATE_PRIOR_SCALE = 4;
+constexpr u32   MATE_PRIOR_MAX   = 64;
+
+// Nodes between checks of the search limits
+constexpr u64 MATE_CHECK_INTERVAL = 1024;
+
+// Percentage of the time and nodes a search without a mate length spends
+// looking for a mate before falling back to the full search
+constexpr u64 MATE_LIMIT_SHARE = 50;
+
+namespace {
+u32 addProofNumbers(const u32 a, const u32 b) { return static_cast<u32>(std::min<u64>(static_cast<u64>(a) + b, PN_INF)); }
+
+struct MateResult {
+    usize    mateIn = 0;
+    Move     bestMove;
+    MoveList pv;
+};
+
+class MateSearch {
+    ProofTable&                 table;
+    RelaxedAtomic<u64>&         nodeCount;
+    const RelaxedAtomic<bool>&  stopFlag;
+    const SearchLimits&         limits;
+    const i64                   timeToSpend;
+    const u64                   nodeLimit;
+    const bool                  usePriors;
+    // The game's positions up to and including the root
+    const vector<u64>&          history;
+    vector<u64>                 path;
+    // Priors of the node being expanded, turned into its
+    // children's initial numbers before any child is searched
+    vector<float>               priors;
+    u64                         repetitions;
+    bool                        aborted;
+
+    bool limitReached() {
+        if (stopFlag.load())
+            return true;
+        if (timeToSpend != 0 && static_cast<i64>(limits.commandTime.elapsed()) >= timeToSpend)
+            return true;
+        return nodeLimit > 0 && nodeCount.load() >= nodeLimit;
+    }
+
+    // Solves nodes that need no search, from the perspective of the side to move
+    // Returns false if the node has to be expanded
+    bool evaluateLeaf(const Board& board, const MoveList& moves, const usize plies, u32& phi, u32& delta) const {
+        const bool attacker = plies % 2 == 1;
+
+        if (moves.length == 0) {
+            // Mated sides always fail, stalemate only fails the attacker
+            const bool sideToMoveWins = !board.inCheck() && !attacker;
+            phi                       = sideToMoveWins ? 0 : PN_INF;
+            delta                     = sideToMoveWins ? PN_INF : 0;
+            return true;
+        }
+
+        // Out of plies without delivering mate
+        if (plies == 0) {
+            phi   = 0;
+            delta = PN_INF;
+            return true;
+        }
+
+        return false;
+    }
+
+    void mid(const Board& board, const usize plies, const u32 thPhi, const u32 thDelta, u32& phi, u32& delta) {
+        const u64 startNodes       = nodeCount.load();
+        const u64 startRepetitions = repetitions;
+        nodeCount.store(startNodes + 1);
+
+        if ((startNodes + 1) % MATE_CHECK_INTERVAL == 0 && limitReached())
+            aborted = true;
+        if (aborted)
+            return;
+
+        const MoveList moves = Movegen::generateMoves(board);
+
+        if (evaluateLeaf(board, moves, plies, phi, delta)) {
+            table.store(board.zobrist, plies, phi, delta, 1);
+            return;
+        }
+
+        const bool attacker = plies % 2 == 1;
+
+        // Sized like the move list so expanding a node doesn't allocate
+        array<u32, 256> childPhi;
+        array<u32, 256> childDelta;
+
+        const bool withPriors = usePriors && attacker;
+        if (withPriors)
+            policyPriors(board, moves, priors);
+
+        path.push_back(board.zobrist);
+
+        for (usize i = 0; i < moves.length; i++) {
+            Board child = board;
+            child.move(moves[i]);
+
+            // A repetition or draw is a refutation, which is a win
+            // for the defender and a loss for the attacker
+            const bool repetition = std::ranges::find(path, child.zobrist) != path.end();
+            repetitions += repetition;
+            if (repetition || std::ranges::count(history, child.zobrist) >= 2 || child.isDraw({})) {
+                childPhi[i]   = attacker ? 0 : PN_INF;
+                childDelta[i] = attacker ? PN_INF : 0;
+            }
+            else if (!table.probe(child.zobrist, plies - 1, childPhi[i], childDelta[i])) {
+                childPhi[i]   = 1;
+                childDelta[i] = 1;
+                if (withPriors) {
+                    const float surprise = -std::log(std::max(priors[i], 1e-6f));
+                    childDelta[i] += std::min(static_cast<u32>(surprise * MATE_PRIOR_SCALE), MATE_PRIOR_MAX);
+                }
+            }
+        }
+
+        while (true) {
+            // phi is the smallest delta of any child, delta the sum of the children's phi
+            usize best   = 0;
+            u32   delta2 = PN_INF;
+            phi          = PN_INF;
+            delta        = 0;
+            for (usize i = 0; i < moves.length; i++) {
+                delta = addProofNumbers(delta, childPhi[i]);
+                if (childDelta[i] < phi) {
+                    delta2 = phi;
+                    phi    = childDelta[i];
+                    best   = i;
+                }
+                else if (childDelta[i] < delta2)
+                    delta2 = childDelta[i];
+            }
+
+            if (phi >= thPhi || delta >= thDelta || aborted)
+                break;
+
+            const u32 childThPhi   = static_cast<u32>(std::min<u64>(static_cast<u64>(thDelta) + childPhi[best] - delta, PN_INF));
+            const u32 childThDelta = std::min<u32>(thPhi, addProofNumbers(delta2, 1));
+
+            Board child = board;
+            child.move(moves[best]);
+            mid(child, plies - 1, childThPhi, childThDelta, childPhi[best], childDelta[best]);
+        }
+
+        path.pop_back();
+
+        const bool attackerFails = attacker ? phi == PN_INF : delta == PN_INF;
+        if (!aborted && !(attackerFails && repetitions > startRepetitions))
+            table.store(board.zobrist, plies, phi, delta, nodeCount.load() - startNodes);
+    }
+
+    // Follows the table from a proven root, the attacker plays
+    // a proven move and the defender any move that was refuted
+    MoveList provenLine(Board board, usize plies) const {
+        MoveList pv;
+
+        while (plies > 0) {
+            const bool     attacker = plies % 2 == 1;
+            const MoveList moves    = Movegen::generateMoves(board);
+
+            Move next = Move::null();
+            for (const Move m : moves) {
+                Board child = board;
+                child.move(m);
+                u32 phi, delta;
+                if (!table.probe(child.zobrist, plies - 1, phi, delta))
+                    continue;
+
+                if ((attacker && delta == 0) || (!attacker && phi == 0)) {
+                    next = m;
+                    break;
+                }
+            }
+
+            if (next == Move::null())
+                break;
+
+            pv.add(next);
+            board.move(next);
+            plies--;
+        }
+
+        return pv;
+    }
+
+    // The root move whose child is closest to being proven mated, from the
+    // deepest iteration with any results, when no mate was found
+    Move mostPromising(const Board& root, const MoveList& rootMoves, usize plies) const {
+        for (; plies >= 1; plies -= 2) {
+            Move best      = Move::null();
+            u32  bestDelta = PN_INF;
+            for (const Move m : rootMoves) {
+                Board child = root;
+                child.move(m);
+                u32 phi, delta;
+                if (table.probe(child.zobrist, plies - 1, phi, delta) && (best.isNull() || delta < bestDelta)) {
+                    best      = m;
+                    bestDelta = delta;
+                }
+            }
+
+            if (!best.isNull() || plies < 2)
+                return best;
+        }
+        return Move::null();
+    }
+
+    // Only share percent of the time and nodes is spent, the rest is
+    // left to a full search when no mate is found
+    static i64 shareOf(const i64 limit, const u64 share) { return limit > 0 ? std::max<i64>(limit * static_cast<i64>(share) / 100, 1) : 0; }
+
+   public:
+    MateSearch(ProofTable&                table,
+               RelaxedAtomic<u64>&        nodeCount,
+               const RelaxedAtomic<bool>& stopFlag,
+               const SearchLimits&        limits,
+               const vector<u64>&         history,
+               const bool                 usePriors,
+               const u64                  share = 100) :
+        table(table),
+        nodeCount(nodeCount),
+        stopFlag(stopFlag),
+        limits(limits),
+        timeToSpend(shareOf(TimeManager(limits).soft(), share)),
+        nodeLimit(static_cast<u64>(shareOf(static_cast<i64>(limits.nodes), share))),
+        usePriors(usePriors),
+        history(history),
+        repetitions(0),
+        aborted(false) {}
+
+    // Iteratively deepens the mate length so the shortest mate is found first
+    template<typename Report>
+    MateResult run(const Board& root, const Report& report) {
+        MateResult result;
+
+        const MoveList rootMoves = Movegen::generateMoves(root);
+        result.bestMove          = rootMoves.length > 0 ? rootMoves[0] : Move::null();
+
+        const usize maxMate = limits.mate > 0 ? limits.mate : MATE_MAX;
+        usize       plies   = 0;
+
+        for (usize mate = 1; mate <= maxMate && !aborted; mate++) {
+            plies = 2 * mate - 1;
+            path.clear();
+
+            u32 phi, delta;
+            mid(root, plies, PN_INF, PN_INF, phi, delta);
+
+            if (aborted)
+                break;
+
+            if (phi == 0) {
+                result.mateIn = mate;
+                result.pv     = provenLine(root, plies);
+                if (result.pv.length > 0)
+                    result.bestMove = result.pv[0];
+                report(mate, result.pv);
+                break;
+            }
+
+            report(mate, MoveList());
+        }
+
+        if (result.mateIn == 0 && plies > 0) {
+            const Move promising = mostPromising(root, rootMoves, plies);
+            if (!promising.isNull())
+                result.bestMove = promising;
+        }
+
+        return result;
+    }
+};
+}  // namespace
+
+template<typename Concurrency>
+Move BasicSearcher<Concurrency>::searchMate(const SearchParameters params, const SearchLimits limits) {
+    nodeCount     = 0;
+    stopSearching = false;
+
+    if (!proofTable)
+        proofTable = std::make_unique<ProofTable>(mateHash);
+    else
+        proofTable->clear();
+
+    // Without a mate length the search is a normal move search, which
+    // falls back to the full search if no mate turns up in its share
+    const bool canFallBack = limits.mate == 0;
+
+    MateSearch mateSearch(*proofTable, nodeCount, stopSearching, limits, params.posHistory, matePolicyPriors, canFallBack ? MATE_LIMIT_SHARE : 100);
+
+    const auto report = [&](const usize mate, const MoveList& pv) {
+        if (!params.doReporting)
+            return;
+
+        const u64 time = limits.commandTime.elapsed();
+        cout << "info depth " << 2 * mate - 1;
+        cout << " time " << time;
+        cout << " nodes " << nodeCount.load();
+        if (time > 0)
+            cout << " nps " << nodeCount.load() * 1000 / time;
+        if (pv.length > 0) {
+            cout << " score mate " << mate << " pv";
+            for (const Move m : pv)
+                cout << " " << m;
+        }
+        cout << endl;
+    };
+
+    const MateResult result = mateSearch.run(rootPos, report);
+
+    if (result.mateIn == 0 && canFallBack && !stopSearching.load()) {
+        SearchLimits remaining = limits;
+        if (limits.nodes > 0)
+            remaining.nodes = limits.nodes - std::min(nodeCount.load(), limits.nodes - 1);
+
+        if (params.doReporting)
+            cout << "info string no mate found, running the full search" << endl;
+        return search(params, remaining);
+    }
+
+    if (params.doReporting) {
+        if (result.mateIn == 0)
+            cout << "info string no mate found" << endl;
+        cout << "bestmove " << result.bestMove << endl;
+    }
+
+    return result.bestMove;
+}
+
+template<typename Concurrency>
+void BasicSearcher<Concurrency>::mateBench() {
+    struct MateTest {
+        const char* fen;
+        usize       mateIn;
+    };
+
+    static constexpr array tests = { MateTest{ "r1bqkb1r/pppp1ppp/2n2n2/4p2Q/2B1P3/8/PPPP1PPP/RNB1K1NR w KQkq - 4 4", 1 },
+                                     MateTest{ "6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - - 0 1", 1 },
+                                     MateTest{ "kbK5/pp6/1P6/8/8/8/8/R7 w - - 0 1", 2 },
+                                     MateTest{ "r2qkb1r/pp2nppp/3p4/2pNN1B1/2BnP3/3P4/PPP2PPP/R2bK2R w KQkq - 1 1", 2 },
+                                     MateTest{ "6k1/pp4p1/2p5/2bp4/8/P5Pb/1P3rrP/2BRRN1K b - - 0 1", 2 },
+                                     MateTest{ "5rk1/1p1q2bp/p2pN1p1/2pP2Bn/2P3P1/1P6/P4QKP/5R2 w - - 1 1", 2 },
+                                     MateTest{ "r1b1kb1r/pppp1ppp/5q2/4n3/3KP3/2N3PN/PPP4P/R1BQ1B1R b kq - 0 1", 3 },
+                                     MateTest{ "2r3k1/p4p2/3Rp2p/1p2P1pK/8/1P4P1/P3Q2P/1q6 b - - 0 1", 3 },
+                                     MateTest{ "r5rk/5p1p/5R2/4B3/8/8/7P/7K w - - 0 1", 3 },
+                                     MateTest{ "3r1r1k/1p3p1p/p2p4/4n1NN/6bQ/1BPq4/P3p1PP/1R5K w - - 0 1", 3 } };
+
+    constexpr u64 NODE_LIMIT = 2'000'000;
+
+    vector<u64>            posHistory;
+    const SearchParameters params(posHistory, false, false, true);
+
+    const string fullName = tree.graph ? "dag " : "full";
+
+    u64 pnNodes = 0, pnTime = 0, fullNodes = 0, fullTime = 0;
+    usize pnSolved = 0, fullSolved = 0;
+
+    for (const MateTest& test : tests) {
+        rootPos.loadFromFEN(test.fen);
+        posHistory = { rootPos.zobrist };
+
+        Stopwatch<std::chrono::milliseconds> pnWatch;
+        const SearchLimits                   pnLimits(pnWatch, test.mateIn, 0, NODE_LIMIT, 0, 0, 0);
+        if (!proofTable)
+            proofTable = std::make_unique<ProofTable>(mateHash);
+        proofTable->clear();
+        stopSearching = false;
+        nodeCount     = 0;
+
+        MateSearch       mateSearch(*proofTable, nodeCount, stopSearching, pnLimits, posHistory, matePolicyPriors);
+        const MateResult result = mateSearch.run(rootPos, [](usize, const MoveList&) {});
+        const u64        pnMs   = pnWatch.elapsed();
+        const bool       pnOk   = result.mateIn == test.mateIn;
+        pnNodes += nodeCount.load();
+        pnTime += pnMs;
+        pnSolved += pnOk;
+        const u64 pnCount = nodeCount.load();
+
+        Stopwatch<std::chrono::milliseconds> fullWatch;
+        const SearchLimits                   fullLimits(fullWatch, 0, 0, NODE_LIMIT, 0, 0, 0);
+        reset();
+        search(params, fullLimits);
+        const u64  fullMs = fullWatch.elapsed();
+        const bool fullOk = tree.root().state.load().state() != ONGOING;
+        fullNodes += nodeCount.load();
+        fullTime += fullMs;
+        fullSolved += fullOk;
+
+        cout << fmt::format("{:<70} mate {}  pn {:>9} nodes {:>6} ms {}  {} {:>9} nodes {:>6} ms {}", test.fen, test.mateIn, pnCount, pnMs, pnOk ? "ok" : "FAIL", fullName, nodeCount.load(), fullMs, fullOk ? "ok" : "FAIL")
+             << endl;
+    }
+
+    cout << fmt::format("pn   {}/{} solved {} nodes {} ms", pnSolved, tests.size(), pnNodes, pnTime) << endl;
+    cout << fmt::format("{} {}/{} solved {} nodes {} ms", fullName, fullSolved, tests.size(), fullNodes, fullTime) << endl;
+}
+
+template Move BasicSearcher<SingleThreaded>::searchMate(const SearchParameters, const SearchLimits);
+template void BasicSearcher<SingleThreaded>::mateBench();
\ No newline at end of file
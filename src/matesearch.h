@@ -0,0 +1,106 @@
+#pragma once
+
+#include "types.h"
+#include "constants.h"
+
+#include <new>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+// Proof and disproof numbers are stored in phi/delta form
+// phi is the cost of proving the goal of the side to move and
+// delta the cost of disproving it, so a node is won for the
+// side to move at (0, INF) and lost at (INF, 0)
+constexpr u32 PN_INF = 1'000'000'000;
+
+struct ProofEntry {
+    u64 key;
+    u32 phi;
+    u32 delta;
+    u32 work;
+    u16 plies;
+};
+
+// A small cluster of entries padded to a cache line, so a probe loads one line
+struct alignas(64) ProofCluster {
+    static constexpr usize SIZE = 2;
+
+    array<ProofEntry, SIZE> entries;
+};
+
+static_assert(sizeof(ProofCluster) == 64);
+
+// Memory bounded table of proof search nodes, keyed by zobrist
+// and the remaining plies. When the cluster is full the
+// entry with the least search work behind it is replaced
+class ProofTable {
+    ProofCluster* table;
+
+   public:
+    u64 size;
+
+    explicit ProofTable(const usize sizeInMB = 16) {
+        table = nullptr;
+        size  = 0;
+        reserve(sizeInMB);
+    }
+
+    ~ProofTable() {
+        if (table != nullptr)
+            std::free(table);
+    }
+
+    void clear() { std::memset(static_cast<void*>(table), 0, size * sizeof(ProofCluster)); }
+
+    void reserve(const usize newSizeMiB) {
+        assert(newSizeMiB > 0);
+        size = newSizeMiB * 1024 * 1024 / sizeof(ProofCluster);
+        if (table != nullptr)
+            std::free(table);
+        // The size is a multiple of the alignment, as aligned_alloc requires
+        table = static_cast<ProofCluster*>(std::aligned_alloc(alignof(ProofCluster), size * sizeof(ProofCluster)));
+        if (table == nullptr) {
+            size = 0;
+            throw std::bad_alloc();
+        }
+        clear();
+    }
+
+    u64 index(const u64 key, const u16 plies) const {
+        const u64 mixed = key ^ (plies * 0x9E3779B97F4A7C15ULL);
+        return static_cast<u64>((static_cast<u128>(mixed) * static_cast<u128>(size)) >> 64);
+    }
+
+    bool probe(const u64 key, const u16 plies, u32& phi, u32& delta) const {
+        const ProofCluster& cluster = table[index(key, plies)];
+        for (const ProofEntry& entry : cluster.entries) {
+            if (entry.key == key && entry.plies == plies && entry.work != 0) {
+                phi   = entry.phi;
+                delta = entry.delta;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void store(const u64 key, const u16 plies, const u32 phi, const u32 delta, const u64 work) {
+        ProofCluster& cluster = table[index(key, plies)];
+        ProofEntry*   replace = &cluster.entries[0];
+
+        for (ProofEntry& entry : cluster.entries) {
+            if (entry.key == key && entry.plies == plies) {
+                replace = &entry;
+                break;
+            }
+            if (entry.work < replace->work)
+                replace = &entry;
+        }
+
+        replace->key   = key;
+        replace->plies = plies;
+        replace->phi   = phi;
+        replace->delta = delta;
+        replace->work  = static_cast<u32>(std::clamp<u64>(work, 1, INF_U32));
+    }
+};
\ No newline at end of file
@@ -1,8 +1,12 @@
 #include "movegen.h"
 #include "types.h"
+#include "perfttable.h"
+#include "threadpool.h"
 
 #include <fstream>
+#include <numeric>
 #include <thread>
+#include <mutex>
 
 MultiArray<u64, 64, 64> LINE;
 MultiArray<u64, 64, 64> LINESEG;
@@ -260,12 +264,54 @@ u64 Movegen::pawnAttackBB(Color c, int sq) {
     return pawnAttackBBs[c][sq];
 }
 
-u64 bulk(Board& board, usize depth) {
+// Perft hash table shared by every perft command
+// it is only allocated when a hash size is given
+PerftTable perftTable;
+
+// Subtrees smaller than this aren't worth a probe
+constexpr usize PERFT_MIN_HASH_DEPTH = 2;
+// Subtrees smaller than this aren't worth a task
+constexpr usize PERFT_MIN_SPLIT_DEPTH = 2;
+// Subtrees smaller than this don't check the time budget
+constexpr usize PERFT_MIN_BUDGET_DEPTH = 3;
+
+// A time budget (in ms) for a count, 0 means there is no budget
+// Once it is spent the count is aborted and its result is meaningless
+struct PerftBudget {
+    u64                                  timeBudget;
+    Stopwatch<std::chrono::milliseconds> stopwatch;
+    atomic<bool>                         aborted;
+
+    explicit PerftBudget(const u64 timeBudget) :
+        timeBudget(timeBudget) {
+        aborted = false;
+    }
+
+    bool expired() {
+        if (timeBudget != 0 && stopwatch.elapsed() >= timeBudget)
+            aborted.store(true, std::memory_order_relaxed);
+        return aborted.load(std::memory_order_relaxed);
+    }
+};
+
+u64 bulk(Board& board, usize depth, PerftTable* table, PerftStats& stats, PerftBudget* budget = nullptr) {
     u64 nodes = 0;
 
     if (depth == 0)
         return 1;
 
+    if (budget != nullptr && depth >= PERFT_MIN_BUDGET_DEPTH && budget->expired())
+        return 0;
+
+    const bool useHash = table != nullptr && depth >= PERFT_MIN_HASH_DEPTH;
+    if (useHash) {
+        stats.probes++;
+        if (table->probe(board.zobrist, depth, nodes)) {
+            stats.hits++;
+            return nodes;
+        }
+    }
+
     MoveList moves = Movegen::generateMoves(board);
 
     if (depth == 1)
@@ -275,96 +321,199 @@ u64 bulk(Board& board, usize depth) {
         Board testBoard = board;
 
         testBoard.move(m);
-        nodes += bulk(testBoard, depth - 1);
+        nodes += bulk(testBoard, depth - 1, table, stats, budget);
     }
 
+    // Never store a partial count
+    if (useHash && (budget == nullptr || !budget->aborted.load(std::memory_order_relaxed)))
+        table->store(board.zobrist, depth, nodes);
+
     return nodes;
 }
 
-u64 multithreadBulk(Board& board, usize depth) {
-    std::atomic<u64> nodes(0);
+u64 perft(Board& board, usize depth, PerftTable* table, PerftStats& stats, PerftBudget* budget = nullptr) {
+    u64 nodes = 0;
 
     if (depth == 0)
         return 1;
 
-    MoveList moves = Movegen::generateMoves(board);
-
-    if (depth == 1)
-        return moves.length;
+    if (budget != nullptr && depth >= PERFT_MIN_BUDGET_DEPTH && budget->expired())
+        return 0;
 
-    std::vector<std::thread> threads;
+    const bool useHash = table != nullptr && depth >= PERFT_MIN_HASH_DEPTH;
+    if (useHash) {
+        stats.probes++;
+        if (table->probe(board.zobrist, depth, nodes)) {
+            stats.hits++;
+            return nodes;
+        }
+    }
 
-    auto runThread = [&](Board board, usize depth) {
-        nodes += bulk(board, depth);
-    };
+    MoveList moves = Movegen::generateMoves(board);
 
     for (Move m : moves) {
         Board testBoard = board;
 
         testBoard.move(m);
 
-        threads.emplace_back(runThread, testBoard, depth - 1);
+        nodes += perft(testBoard, depth - 1, table, stats, budget);
     }
 
-    for (std::thread& t : threads)
-        if (t.joinable())
-            t.join();
+    // Never store a partial count
+    if (useHash && (budget == nullptr || !budget->aborted.load(std::memory_order_relaxed)))
+        table->store(board.zobrist, depth, nodes);
 
     return nodes;
 }
 
-u64 perft(Board& board, usize depth) {
-    u64 nodes = 0;
+// Parallel perft driven by a work-stealing pool
+// Every move within the first splitPly plies becomes its own task,
+// deeper subtrees are counted sequentially by whichever worker runs them
+struct ParallelPerft {
+    ThreadPool& pool;
+    PerftTable* table;
+    bool        bulkCount;
+    usize       splitPly;
+
+    PerftBudget budget;
+
+    atomic<u64> probes;
+    atomic<u64> hits;
+
+    ParallelPerft(ThreadPool& pool, PerftTable* table, const bool bulkCount, const usize splitPly, const u64 timeBudget = 0) :
+        pool(pool),
+        table(table),
+        bulkCount(bulkCount),
+        splitPly(splitPly),
+        budget(timeBudget) {
+        probes = 0;
+        hits   = 0;
+    }
 
-    if (depth == 0)
-        return 1;
+    void addStats(const PerftStats& stats) {
+        probes.fetch_add(stats.probes, std::memory_order_relaxed);
+        hits.fetch_add(stats.hits, std::memory_order_relaxed);
+    }
 
-    MoveList moves = Movegen::generateMoves(board);
+    PerftStats stats() const {
+        PerftStats s{};
+        s.probes = probes.load();
+        s.hits   = hits.load();
+        return s;
+    }
 
-    for (Move m : moves) {
-        Board testBoard = board;
+    // The result is meaningless once the count has been aborted
+    u64 count(Board& board, const usize depth, const usize ply) {
+        PerftStats localStats{};
 
-        testBoard.move(m);
+        if (budget.expired())
+            return 0;
+
+        // Small subtrees cost less than the task overhead
+        if (ply >= splitPly || depth <= PERFT_MIN_SPLIT_DEPTH) {
+            const u64 nodes = bulkCount ? bulk(board, depth, table, localStats, &budget) : perft(board, depth, table, localStats, &budget);
+            addStats(localStats);
+            return nodes;
+        }
+
+        u64 hashedNodes;
+        if (table != nullptr) {
+            localStats.probes++;
+            if (table->probe(board.zobrist, depth, hashedNodes)) {
+                localStats.hits++;
+                addStats(localStats);
+                return hashedNodes;
+            }
+            addStats(localStats);
+        }
+
+        const vector<u64> counts = countMoves(board, depth, ply, Movegen::generateMoves(board));
+        const u64         nodes  = std::accumulate(counts.begin(), counts.end(), 0ULL);
 
-        nodes += perft(testBoard, depth - 1);
+        // Never store a partial count
+        if (table != nullptr && !budget.aborted.load(std::memory_order_relaxed))
+            table->store(board.zobrist, depth, nodes);
+
+        return nodes;
     }
 
-    return nodes;
+    // Count the subtree of each move in parallel
+    vector<u64> countMoves(const Board& board, const usize depth, const usize ply, const MoveList& moves) {
+        vector<u64> counts(moves.length);
+
+        TaskGroup group(pool);
+        for (usize i = 0; i < moves.length; i++) {
+            group.run([&, i]() {
+                Board testBoard = board;
+
+                testBoard.move(moves[i]);
+                counts[i] = count(testBoard, depth - 1, ply + 1);
+            });
+        }
+        group.wait();
+
+        return counts;
+    }
+};
+
+void printHashStats(const PerftStats& stats) {
+    cout << "Hash hit rate: " << fmt::format("{:.2f}", stats.hitRate() * 100) << "% (" << formatNum(stats.hits) << " / " << formatNum(stats.probes) << " probes)" << endl;
 }
 
-void Movegen::perft(Board& board, usize depth, bool bulk) {
-    u64 nodes = 0;
+void Movegen::perft(Board& board, usize depth, bool bulk, const PerftParameters& params) {
+    depth = std::max<usize>(depth, 1);
 
-    MoveList moves = generateMoves(board);
+    perftTable.reserve(params.hashMB);
+    PerftTable* table = perftTable.enabled() ? &perftTable : nullptr;
 
-    u64 nodesThisMove = 0;
+    ThreadPool    pool(params.threads);
+    ParallelPerft engine(pool, table, bulk, params.splitPly);
+
+    MoveList moves = generateMoves(board);
 
     Stopwatch<std::chrono::milliseconds> stopwatch;
 
     stopwatch.start();
 
-    for (Move m : moves) {
-        Board testBoard = board;
-
-        testBoard.move(m);
-        if (bulk)
-            nodesThisMove = ::bulk(testBoard, depth - 1);
-        else
-            nodesThisMove = perft(testBoard, depth - 1);
-        nodes += nodesThisMove;
-
-        cout << m << ": " << nodesThisMove << endl;
-    }
+    const vector<u64> moveNodes = engine.countMoves(board, depth, 0, moves);
+    const u64         nodes     = std::accumulate(moveNodes.begin(), moveNodes.end(), 0ULL);
 
     u64 elapsedTime = stopwatch.elapsed();
 
+    for (usize i = 0; i < moves.length; i++)
+        cout << moves[i] << ": " << moveNodes[i] << endl;
+
     cout << "Total nodes: " << formatNum(nodes) << endl;
     cout << "Time spent (ms): " << elapsedTime << endl;
     cout << "Nodes per second: " << formatNum(nodes * 1000 / std::max<u64>(elapsedTime, 1)) << endl;
+    cout << "Threads: " << params.threads << endl;
+    if (table != nullptr)
+        printHashStats(engine.stats());
+
+    // Recount every root move without the hash table
+    // any difference means the table returned a bad count
+    if (params.verify && table != nullptr) {
+        ParallelPerft     unhashed(pool, nullptr, bulk, params.splitPly);
+        const vector<u64> expected = unhashed.countMoves(board, depth, 0, moves);
+        bool              passed   = true;
+
+        for (usize i = 0; i < moves.length; i++) {
+            if (expected[i] != moveNodes[i]) {
+                cout << "Hash mismatch on " << moves[i] << ": hashed " << moveNodes[i] << ", unhashed " << expected[i] << endl;
+                passed = false;
+            }
+        }
+
+        cout << "Hash self-check: " << (passed ? "PASS" : "FAIL") << endl;
+    }
 }
 
-void Movegen::perftSuite(const string filePath) {
-    Board board;
+bool Movegen::perftSuite(const string filePath, const PerftParameters& params) {
+    struct PerftJob {
+        string fen;
+        usize  depth;
+        u64    expected;
+    };
 
     Stopwatch<std::chrono::milliseconds> sw;
     sw.start();
@@ -373,74 +522,116 @@ void Movegen::perftSuite(const string filePath) {
 
     if (!file.is_open()) {
         cerr << "Failed to open file: " << filePath << endl;
-        return;
+        return false;
     }
 
-    string ln;
-
-    usize testsDone = 0;
-    usize passedTests = 0;
-    u64 totalNodes = 0;
-
-
-
+    // Every (position, depth) pair is an independent job
+    vector<PerftJob> jobs;
+    string           ln;
     while (std::getline(file, ln)) {
         if (ln.empty())
             continue;
 
-        Stopwatch<std::chrono::milliseconds> sw;
-        sw.start();
-
         std::vector<string> tokens = split(ln, ';');
+        const string        fen    = tokens[0].substr(0, tokens[0].find_last_not_of(' ') + 1);
 
-        u64 nodes;
+        for (usize i = 1; i < tokens.size(); i++) {
+            std::vector<string> entry = split(tokens[i], ' ');
 
-        board.loadFromFEN(tokens[0]);
+            const usize depth  = stoi(entry[0].substr(1));
+            const u64   target = stoll(entry[1]);
 
-        bool passed = true;
-        cout << "Testing position: " << tokens[0] << endl;
+            if (params.maxDepth == 0 || depth <= params.maxDepth)
+                jobs.push_back({ fen, depth, target });
+        }
+    }
 
-        for (usize i = 1; i < tokens.size(); i++) {
-            std::vector<string> entry = split(tokens[i], ' ');
+    // Largest jobs first so no core is left with a huge
+    // job at the end, the expected count is an exact size
+    std::ranges::stable_sort(jobs, std::greater{}, &PerftJob::expected);
 
-            usize depth = stoi(entry[0].substr(1));
-            u64 target = stoll(entry[1]);
+    perftTable.reserve(params.hashMB);
+    PerftTable* table = perftTable.enabled() ? &perftTable : nullptr;
 
-            nodes = multithreadBulk(board, depth);
+    ThreadPool pool(params.threads);
 
-            totalNodes += nodes;
+    atomic<usize> passedTests(0);
+    atomic<usize> failedTests(0);
+    atomic<usize> timedOutTests(0);
+    atomic<u64>   totalNodes(0);
+    atomic<u64>   probes(0);
+    atomic<u64>   hits(0);
+    std::mutex    outputMutex;
 
-            bool pass = nodes == target;
-            cout << "Depth " << depth << ": Expected " << target << ", Got " << nodes << " -> " << (pass ? "PASS" : "FAIL") << endl;
+    // Jobs are isolated tasks started in order, and split into stealable
+    // tasks themselves. A job waiting on its tasks only runs tasks of the
+    // same job, so its time and budget aren't spent on other jobs
+    const auto runJob = [&](const PerftJob& job) {
+        Board board;
+        board.loadFromFEN(job.fen);
 
-            testsDone++;
-            if (pass)
-                passedTests++;
-            else
-                passed = false;
-        }
+        ParallelPerft engine(pool, table, true, params.splitPly, params.timeBudget);
 
-        u64 elapsed = sw.elapsed();
-        usize nps = totalNodes * 1000 / std::max<u64>(elapsed, 1);
+        const u64  nodes    = engine.count(board, job.depth, 0);
+        const u64  elapsed  = engine.budget.stopwatch.elapsed();
+        const u64  nps      = nodes * 1000 / std::max<u64>(elapsed, 1);
+        const bool timedOut = engine.budget.aborted.load();
+        const bool pass     = !timedOut && nodes == job.expected;
 
-        cout << "Time elapsed: " << formatTime(elapsed) << endl;
-        cout << "Found " << formatNum(nodes) << " nodes at " << formatNum(nps) << " nodes per second" << endl;
+        const PerftStats stats = engine.stats();
+        probes += stats.probes;
+        hits += stats.hits;
 
-        cout << "Finished position " << testsDone << endl;
-        if (passed)
-            cout << "All tests passed for this position." << endl;
+        if (timedOut)
+            timedOutTests++;
+        else {
+            totalNodes += nodes;
+            (pass ? passedTests : failedTests)++;
+        }
+
+        const string status = timedOut ? "timeout" : pass ? "pass" : "fail";
+
+        std::lock_guard lk(outputMutex);
+        if (params.json)
+            cout << fmt::format(R"({{"fen":"{}","depth":{},"expected":{},"actual":{},"ms":{},"nps":{},"status":"{}"}})", job.fen, job.depth, job.expected,
+                                timedOut ? "null" : std::to_string(nodes), elapsed, timedOut ? 0 : nps, status)
+                 << endl;
+        else if (timedOut)
+            cout << "Depth " << job.depth << " of " << job.fen << ": Exceeded the time budget after " << formatTime(elapsed) << " -> TIMEOUT" << endl;
         else
-            cout << "Some tests failed for this position." << endl;
+            cout << "Depth " << job.depth << " of " << job.fen << ": Expected " << job.expected << ", Got " << nodes << " in " << formatTime(elapsed) << " -> " << (pass ? "PASS" : "FAIL") << endl;
+    };
 
-        cout << "----------------------------------------" << endl << endl;
+    {
+        TaskGroup group(pool);
+        for (const PerftJob& job : jobs)
+            group.run([&]() { runJob(job); }, true);
+        group.wait();
     }
 
-    cout << "Perft Suite Completed: " << passedTests << " / " << testsDone << " tests passed." << endl;
-    u64 elapsed = sw.elapsed();
-    usize nps = totalNodes * 1000 / std::max<u64>(elapsed, 1);
+    const u64   elapsed = sw.elapsed();
+    const usize nps     = totalNodes * 1000 / std::max<u64>(elapsed, 1);
+
+    PerftStats stats{};
+    stats.probes = probes;
+    stats.hits   = hits;
+
+    if (params.json) {
+        cout << fmt::format(R"({{"summary":true,"tests":{},"passed":{},"failed":{},"timeouts":{},"nodes":{},"ms":{},"nps":{},"hashhitrate":{:.4f}}})", jobs.size(), passedTests.load(),
+                            failedTests.load(), timedOutTests.load(), totalNodes.load(), elapsed, nps, stats.hitRate())
+             << endl;
+    }
+    else {
+        cout << "Perft Suite Completed: " << passedTests << " / " << jobs.size() << " tests passed." << endl;
+        if (timedOutTests > 0)
+            cout << timedOutTests << " tests exceeded the time budget." << endl;
+        cout << "Time elapsed: " << formatTime(elapsed) << endl;
+        cout << "Found a total of " << formatNum(totalNodes) << " nodes at " << formatNum(nps) << " nodes per second" << endl;
+        if (table != nullptr)
+            printHashStats(stats);
+    }
 
-    cout << "Time elapsed: " << formatTime(elapsed) << endl;
-    cout << "Found a total of " << formatNum(totalNodes) << " nodes at " << formatNum(nps) << " nodes per second" << endl;
+    return failedTests == 0 && timedOutTests == 0;
 }
 
 u64 Movegen::pawnAttacks(Color c, const Board& board) {
@@ -10,6 +10,35 @@ enum MovegenMode {
     NOISY_ONLY
 };
 
+constexpr usize DEFAULT_PERFT_SPLIT_PLY = 2;
+
+struct PerftParameters {
+    // A hash size of 0 MB runs perft without the perft hash table
+    usize hashMB;
+    usize threads;
+    // Moves within this many plies of the root are split into tasks
+    usize splitPly;
+    // Recount without the hash table and compare
+    bool verify;
+
+    // Perft suite only
+    // Depths above maxDepth are skipped and jobs running longer than
+    // timeBudget ms are aborted, 0 disables either cap
+    usize maxDepth;
+    u64   timeBudget;
+    // Print results as JSON lines
+    bool json;
+
+    PerftParameters(const usize hashMB, const usize threads, const usize splitPly, const bool verify, const usize maxDepth = 0, const u64 timeBudget = 0, const bool json = false) :
+        hashMB(hashMB),
+        threads(std::max<usize>(threads, 1)),
+        splitPly(splitPly),
+        verify(verify),
+        maxDepth(maxDepth),
+        timeBudget(timeBudget),
+        json(json) {}
+};
+
 namespace Movegen {
 // Tables from https://github.com/Disservin/chess-library/blob/cf3bd56474168605201a01eb78b3222b8f9e65e4/include/chess.hpp#L780
 constexpr u64 KNIGHT_ATTACKS[64] = { 0x0000000000020400, 0x0000000000050800, 0x00000000000A1100, 0x0000000000142200, 0x0000000000284400, 0x0000000000508800, 0x0000000000A01000, 0x0000000000402000,
@@ -46,8 +75,9 @@ void initializeAllDatabases();
 
 MoveList generateMoves(const Board& board);
 
-void perft(Board& board, usize depth, bool bulk);
-void perftSuite(const string filePath);
+void perft(Board& board, usize depth, bool bulk, const PerftParameters& params);
+// Returns false if any test failed
+bool perftSuite(const string filePath, const PerftParameters& params);
 
 u64 getBishopAttacks(Square square, u64 occ);
 u64 getXrayBishopAttacks(Square square, u64 occ, u64 blockers);
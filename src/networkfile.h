@@ -0,0 +1,49 @@
+#pragma once
+
+#include "types.h"
+
+#include <fstream>
+
+// Weights of a network read from a file at runtime, in the same layout as
+// the embedded networks and aligned for the widest vector loads
+class NetworkFile {
+    struct alignas(64) Line {
+        array<char, 64> bytes;
+    };
+
+    vector<Line> lines;
+
+   public:
+    bool isOpen() const { return !lines.empty(); }
+
+    const void* data() const { return lines.data(); }
+
+    // The file must hold every weight of a network of the given size,
+    // which includes the padding at the end of its struct, so files padded
+    // to the alignment like the embedded networks are accepted too
+    bool load(const string& path, const usize size) {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file)
+            return false;
+
+        const usize fileSize = file.tellg();
+        if (fileSize > size || fileSize + sizeof(Line) <= size)
+            return false;
+
+        vector<Line> read((size + sizeof(Line) - 1) / sizeof(Line), Line{});
+        file.seekg(0);
+        if (!file.read(reinterpret_cast<char*>(read.data()), fileSize))
+            return false;
+
+        lines = std::move(read);
+        return true;
+    }
+
+    // Zeroed weights, which evaluate at the same speed as trained ones
+    void zero(const usize size) { lines.assign((size + sizeof(Line) - 1) / sizeof(Line), Line{}); }
+
+    void close() {
+        lines.clear();
+        lines.shrink_to_fit();
+    }
+};
\ No newline at end of file
@@ -4,18 +4,36 @@
 #include "move.h"
 #include "search.h"
 #include "ttable.h"
+#include "experience.h"
+#include "tablebase.h"
+#include "simd.h"
 
-struct Node {
-    RelaxedAtomic<float>     totalScore;
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Backprop updates the statistics through the Concurrency policy, SingleThreaded
+// or MultiThreaded, of the tree the node belongs to
+template<typename Concurrency>
+struct BasicNode {
+    // Scores are summed in fixed point so backprop is a single integer add
+    // and the sum doesn't lose precision as visits grow
+    static constexpr i64 SCORE_ONE = 1LL << 28;
+
+    RelaxedAtomic<i64>       totalScore;
     RelaxedAtomic<NodeIndex> firstChild;
     RelaxedAtomic<u64>       visits;
     RelaxedAtomic<float>     policy;
     RelaxedAtomic<Move>      move;
     RelaxedAtomic<GameState> state;
     RelaxedAtomic<u8>        numChildren;
+    // Legal moves of the position, more than numChildren when not every move is materialized
+    RelaxedAtomic<u8>        numMoves;
+    // Index of the child with the best score, kept up to date in backprop
+    RelaxedAtomic<u8>        pvChild;
     RelaxedAtomic<float>     giniImpurity;
 
-    Node() {
+    BasicNode() {
         totalScore   = 0;
         visits       = 0;
         firstChild   = { 0, 0 };
@@ -23,10 +41,12 @@ struct Node {
         state        = ONGOING;
         move         = Move::null();
         numChildren  = 0;
+        numMoves     = 0;
+        pvChild      = 0;
         giniImpurity = 0;
     }
 
-    Node(const Node& other) {
+    BasicNode(const BasicNode& other) {
         totalScore   = other.totalScore.load();
         visits       = other.visits.load();
         firstChild   = other.firstChild.load();
@@ -34,10 +54,12 @@ struct Node {
         state        = other.state.load();
         move         = other.move.load();
         numChildren  = other.numChildren.load();
+        numMoves     = other.numMoves.load();
+        pvChild      = other.pvChild.load();
         giniImpurity = other.giniImpurity.load();
     }
 
-    Node& operator=(const Node& other) {
+    BasicNode& operator=(const BasicNode& other) {
         if (this != &other) {
             totalScore   = other.totalScore.load();
             firstChild   = other.firstChild.load();
@@ -47,33 +69,150 @@ struct Node {
             move         = other.move.load();
             state        = other.state.load();
             numChildren  = other.numChildren.load();
+            numMoves     = other.numMoves.load();
+            pvChild      = other.pvChild.load();
             giniImpurity = other.giniImpurity.load();
         }
         return *this;
     }
 
+    static i64 toFixed(const float score) { return static_cast<i64>(std::llround(static_cast<double>(score) * SCORE_ONE)); }
+
     // Get the WDL of a node, adjusted for game end states
     float getScore() const {
         assert(visits.load());
-        return totalScore.load() / visits.load();
+        return static_cast<double>(totalScore.load()) / SCORE_ONE / visits.load();
     }
 
+    // Sum of the scores backpropagated through the node
+    float getScoreSum() const { return static_cast<double>(totalScore.load()) / SCORE_ONE; }
+
+    void addScore(const float score) { Concurrency::add(totalScore, toFixed(score)); }
+    void addVisit() { Concurrency::add(visits, 1); }
+    void setScore(const float score) { totalScore = toFixed(score) * static_cast<i64>(visits.load()); }
+
     bool isExpanded() const { return numChildren.load() > 0; }
     bool isTerminal() const { return state.load().state() != ONGOING; }
 
-    bool operator==(const Node& other) const { return visits == other.visits.load() && firstChild.load() == other.firstChild.load(); }
+    bool operator==(const BasicNode& other) const { return visits == other.visits.load() && firstChild.load() == other.firstChild.load(); }
 };
 
 
-class Tree {
-    u8 currentHalf;
+// The best few children of the root in order, for MultiPV
+// Only the child that was just searched can change score, so the list
+// is updated in place and only rebuilt when a listed child falls out
+class TopChildren {
+    array<u8, 256> indices;
+    usize          count;
+    usize          k;
 
    public:
-    array<vector<Node>, 2> nodes;
-    TranspositionTable     tt;
-    RelaxedAtomic<bool>    switchHalves;
+    TopChildren() {
+        count = 0;
+        k     = 1;
+    }
+
+    usize size() const { return count; }
+    u8    operator[](const usize idx) const { return indices[idx]; }
+
+    template<typename Node, typename Score>
+    void rebuild(const Node* children, const usize numChildren, const usize newK, const Score& score) {
+        k     = std::max<usize>(newK, 1);
+        count = 0;
+        for (usize idx = 0; idx < numChildren; idx++)
+            indices[count++] = idx;
+
+        const usize kept = std::min(k, count);
+        std::partial_sort(indices.begin(), indices.begin() + kept, indices.begin() + count, [&](const u8 a, const u8 b) { return score(children[a]) > score(children[b]); });
+        count = kept;
+    }
+
+    template<typename Node, typename Score>
+    void update(const Node* children, const usize numChildren, const u8 changed, const Score& score) {
+        const auto end    = indices.begin() + count;
+        const auto listed = std::find(indices.begin(), end, changed);
+        const bool wasIn  = listed != end;
+        if (wasIn) {
+            std::copy(listed + 1, end, listed);
+            count--;
+        }
+
+        const float changedScore = score(children[changed]);
+
+        // A listed child that fell below the last one may have been
+        // passed by a child that isn't listed
+        if (wasIn && count > 0 && changedScore < score(children[indices[count - 1]]) && numChildren > k) {
+            rebuild(children, numChildren, k, score);
+            return;
+        }
+
+        if (count == k && (count == 0 || changedScore <= score(children[indices[count - 1]])))
+            return;
+
+        usize pos = count;
+        while (pos > 0 && score(children[indices[pos - 1]]) < changedScore) {
+            if (pos < k)
+                indices[pos] = indices[pos - 1];
+            pos--;
+        }
+        indices[pos] = changed;
+        count        = std::min(count + 1, k);
+    }
+};
+
+// What selection reads of every node, as a structure of arrays beside the nodes so
+// a parent's children are scored a vector at a time. Each entry mirrors its node
+// and is refreshed by the tree whenever the node changes under its parent
+struct SelectionLanes {
+    // Q from the parent's side, -inf for children proven to win for the opponent
+    vector<float> q;
+    vector<float> policy;
+    // Visits as floats, at least 1 for proven wins so their Q is used
+    vector<float> visits;
+
+    static constexpr usize BYTES_PER_NODE = 3 * sizeof(float);
 
-    Tree() {
+    void resize(const usize size) {
+        // Vector loads at the last child of a half read past its end
+        q.resize(size + simd::VECTOR_SIZE<float>);
+        policy.resize(size + simd::VECTOR_SIZE<float>);
+        visits.resize(size + simd::VECTOR_SIZE<float>);
+    }
+};
+
+// A tree searched by one thread is a BasicTree<SingleThreaded>,
+// one shared between threads a BasicTree<MultiThreaded>
+template<typename Concurrency>
+class BasicTree {
+    u8  currentHalf;
+    u64 sizeMB;
+
+   public:
+    using Node = BasicNode<Concurrency>;
+
+    array<vector<Node>, 2>   nodes;
+    array<SelectionLanes, 2> lanes;
+    TranspositionTable       tt;
+    RelaxedAtomic<bool>      switchHalves;
+    TopChildren              rootTop;
+    // Persists across games, only cleared by deleting the file
+    ExperienceTable experience;
+    // Positions they cover are proven when first visited
+    Tablebases tablebases;
+    // Positions reached through different move orders share their
+    // statistics through the TT rather than being searched separately
+    bool graph;
+    // Nodes below the root only materialize their best
+    // children by policy, more as they gain visits
+    bool widening;
+    // The descent starts loading what the selected child's visit reads
+    // while the move is made
+    bool prefetch;
+
+    BasicTree() {
+        graph    = false;
+        widening = false;
+        prefetch = true;
         resize(DEFAULT_HASH);
         currentHalf  = 0;
         switchHalves = false;
@@ -88,16 +227,29 @@ class Tree {
     void resize(const u64 newMB) {
         // The TT gets 1/16th of the hash
         // and the main tree gets the other
-        // 15/16ths
-        const u64 treeAllocSize = newMB * 1024 * 1024 * 15 / sizeof(Node) / 16;
+        // 15/16ths. A graph keeps an entry for
+        // every position so its TT gets 1/4th
+        const u64 ttShare       = graph ? 4 : 16;
+        const u64 treeAllocSize = newMB * 1024 * 1024 * (ttShare - 1) / (sizeof(Node) + SelectionLanes::BYTES_PER_NODE) / ttShare;
+
+        sizeMB = newMB;
 
         nodes[0].resize(treeAllocSize / 2);
         nodes[1].resize(treeAllocSize / 2);
+        lanes[0].resize(treeAllocSize / 2);
+        lanes[1].resize(treeAllocSize / 2);
 
-        tt.reserve(newMB / 16);
+        tt.reserve(std::max<u64>(newMB / ttShare, 1));
         tt.clear(std::thread::hardware_concurrency());
     }
 
+    void setGraph(const bool enabled) {
+        if (graph == enabled)
+            return;
+        graph = enabled;
+        resize(sizeMB);
+    }
+
     u8   activeHalf() const { return currentHalf; }
     void switchHalf() { currentHalf ^= 1; }
 
@@ -118,4 +270,45 @@ class Tree {
         assert(idx.index() < nodes[0].size());
         return nodes[idx.half()][idx.index()];
     }
+
+    // Refresh the selection lanes of a node's child after it changed
+    void syncLane(const Node& parent, const usize childIdx) {
+        const NodeIndex first = parent.firstChild.load();
+        const usize     idx   = first.index() + childIdx;
+        const Node&     child = nodes[first.half()][idx];
+        const u64       v     = child.visits.load();
+        const bool      won   = child.state.load().state() == WIN;
+
+        SelectionLanes& l = lanes[first.half()];
+        l.q[idx]          = won ? -std::numeric_limits<float>::infinity() : v > 0 ? -child.getScore() : 0;
+        l.policy[idx]     = child.policy.load();
+        l.visits[idx]     = std::max<u64>(v, won);
+    }
+
+    // Start loading the lanes selection reads for a node's children, and the first child
+    void prefetchChildren(const Node& parent) const {
+        const NodeIndex       first = parent.firstChild.load();
+        const SelectionLanes& l     = lanes[first.half()];
+        const usize           count = parent.numChildren.load();
+
+        __builtin_prefetch(&nodes[first.half()][first.index()]);
+        for (usize idx = 0; idx < count; idx += 64 / sizeof(float)) {
+            __builtin_prefetch(&l.q[first.index() + idx]);
+            __builtin_prefetch(&l.policy[first.index() + idx]);
+            __builtin_prefetch(&l.visits[first.index() + idx]);
+        }
+    }
+
+    // Whether every child of a node is proven to win for the opponent
+    bool childrenLost(const Node& parent) const {
+        const NodeIndex first = parent.firstChild.load();
+        const float*    q     = &lanes[first.half()].q[first.index()];
+        return std::all_of(q, q + parent.numChildren.load(), [](const float v) { return v == -std::numeric_limits<float>::infinity(); });
+    }
+
+    // Refresh the selection lanes of every child of a node
+    void syncLanes(const Node& parent) {
+        for (usize idx = 0; idx < parent.numChildren.load(); idx++)
+            syncLane(parent, idx);
+    }
 };
\ No newline at end of file
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "types.h"
+
+#include <vector>
+#include <thread>
+#include <cstring>
+
+// Counters kept per perft thread so that
+// probing does not contend on shared atomics
+struct PerftStats {
+    u64 probes = 0;
+    u64 hits   = 0;
+
+    PerftStats& operator+=(const PerftStats& other) {
+        probes += other.probes;
+        hits += other.hits;
+        return *this;
+    }
+
+    float hitRate() const { return probes == 0 ? 0 : static_cast<float>(hits) / probes; }
+};
+
+// Lockless perft entry (Hyatt style), the key is stored
+// XORed with the data so a torn write from another thread
+// simply fails verification instead of returning a bad count
+struct PerftEntry {
+    atomic<u64> check;
+    atomic<u64> data;
+
+    static u64 pack(const u64 nodes, const usize depth) { return nodes << 8 | depth; }
+};
+
+class PerftTable {
+    PerftEntry* table;
+
+   public:
+    u64 size;
+
+    PerftTable() {
+        table = nullptr;
+        size  = 0;
+    }
+
+    ~PerftTable() {
+        if (table != nullptr)
+            std::free(table);
+    }
+
+    void clear(const usize threadCount = 1) {
+        assert(threadCount > 0);
+
+        if (table == nullptr)
+            return;
+
+        std::vector<std::thread> threads;
+
+        auto clearTable = [&](const usize threadId) {
+            const usize start = (size * threadId) / threadCount;
+            const usize end   = std::min((size * (threadId + 1)) / threadCount, size);
+
+            std::memset(static_cast<void*>(table + start), 0, (end - start) * sizeof(PerftEntry));
+        };
+
+        for (usize thread = 1; thread < threadCount; thread++)
+            threads.emplace_back(clearTable, thread);
+
+        clearTable(0);
+
+        for (std::thread& t : threads)
+            if (t.joinable())
+                t.join();
+    }
+
+    // Resizes the table, a size of 0 disables hashing
+    void reserve(const usize newSizeMiB) {
+        const u64 newSize = newSizeMiB * 1024 * 1024 / sizeof(PerftEntry);
+        if (newSize == size)
+            return;
+
+        if (table != nullptr)
+            std::free(table);
+
+        size  = newSize;
+        table = size == 0 ? nullptr : static_cast<PerftEntry*>(std::malloc(size * sizeof(PerftEntry)));
+        // hardware_concurrency() may be 0 when it can't be determined
+        clear(std::max(1u, std::thread::hardware_concurrency()));
+    }
+
+    bool enabled() const { return size > 0; }
+
+    u64 index(const u64 key) const { return static_cast<u64>((static_cast<u128>(key) * static_cast<u128>(size)) >> 64); }
+
+    // Spread the depths of a single position across the table
+    static u64 slotKey(const u64 key, const usize depth) { return key ^ (depth * 0x9E3779B97F4A7C15ULL); }
+
+    bool probe(const u64 key, const usize depth, u64& nodes) const {
+        const PerftEntry& entry = table[index(slotKey(key, depth))];
+        const u64         data  = entry.data.load(std::memory_order_relaxed);
+        const u64         check = entry.check.load(std::memory_order_relaxed);
+
+        if ((check ^ data) != key || (data & 0xFF) != depth)
+            return false;
+
+        nodes = data >> 8;
+        return true;
+    }
+
+    void store(const u64 key, const usize depth, const u64 nodes) {
+        assert(depth < 256);
+        PerftEntry& entry = table[index(slotKey(key, depth))];
+        const u64   data  = PerftEntry::pack(nodes, depth);
+
+        entry.check.store(key ^ data, std::memory_order_relaxed);
+        entry.data.store(data, std::memory_order_relaxed);
+    }
+};
\ No newline at end of file
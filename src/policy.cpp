@@ -8,6 +8,8 @@
 
 #include "movegen.h"
 #include "simd.h"
+#include "stopwatch.h"
+#include "networkfile.h"
 #include "../external/incbin.h"
 
 #ifdef MSVC
@@ -25,19 +27,26 @@ constexpr usize ALIGNMENT = 64;
 constexpr usize ALIGNMENT = 32;
 #endif
 
+template<usize HL, int ACTIVATION>
+struct PolicyNN;
+
+template<usize HL>
 struct PolicyAccumulator {
-    alignas(ALIGNMENT) array<i16, HL_SIZE_P> underlying;
+    alignas(ALIGNMENT) array<i16, HL> underlying;
 
-    explicit PolicyAccumulator(const Board& board);
+    // Primes childValues for the board's children in the same pass when it is given and due
+    template<int ACTIVATION>
+    PolicyAccumulator(const PolicyNN<HL, ACTIVATION>& nn, const Board& board, ValueCache* childValues);
 
     const i16& operator[](const usize& idx) const { return underlying[idx]; }
     i16&       operator[](const usize& idx) { return underlying[idx]; }
 };
 
+template<usize HL, int ACTIVATION>
 struct PolicyNN {
-    alignas(ALIGNMENT) array<i8, HL_SIZE_P * 768> weightsToHL;
-    alignas(ALIGNMENT) array<i8, HL_SIZE_P> hiddenLayerBias;
-    alignas(ALIGNMENT) MultiArray<i8, 1880, HL_SIZE_P> weightsToOut;
+    alignas(ALIGNMENT) array<i8, HL * 768> weightsToHL;
+    alignas(ALIGNMENT) array<i8, HL> hiddenLayerBias;
+    alignas(ALIGNMENT) MultiArray<i8, 1880, HL> weightsToOut;
     array<i8, 1880> outputBiases;
 
     static i16 ReLU(const i16 x);
@@ -45,54 +54,73 @@ struct PolicyNN {
     static i32 SCReLU(const i16 x);
 
     static usize feature(const Color stm, const Color pieceColor, const PieceType piece, const Square square);
-};
 
-const PolicyNN nn = *reinterpret_cast<const PolicyNN*>(gPOLICYData);
+    float policyScore(Color stm, const PolicyAccumulator<HL>& policyAccumulator, Move m) const;
+    // Raw score of every move
+    void logits(const Board& board, const MoveList& moves, vector<float>& scores, ValueCache* childValues) const;
+};
 
-PolicyAccumulator::PolicyAccumulator(const Board& board) {
+template<usize HL>
+template<int ACTIVATION>
+PolicyAccumulator<HL>::PolicyAccumulator(const PolicyNN<HL, ACTIVATION>& nn, const Board& board, ValueCache* childValues) {
     u64 whitePieces = board.pieces(WHITE);
     u64 blackPieces = board.pieces(BLACK);
 
     for (usize i = 0; i < underlying.size(); i++)
         underlying[i] = nn.hiddenLayerBias[i];
 
+    const bool primed = childValues && childValues->prime(board);
+
+    // Each piece is looked up once, and the value net's
+    // weight row for it streamed right after the policy net's
     while (whitePieces) {
-        const Square sq = popLSB(whitePieces);
+        const Square    sq    = popLSB(whitePieces);
+        const PieceType piece = board.getPiece(sq);
 
-        const usize feature = PolicyNN::feature(board.stm, WHITE, board.getPiece(sq), sq);
+        const usize feature = PolicyNN<HL, ACTIVATION>::feature(board.stm, WHITE, piece, sq);
 
-        for (usize i = 0; i < HL_SIZE_P; i++)
-            underlying[i] += nn.weightsToHL[feature * HL_SIZE_P + i];
+        for (usize i = 0; i < HL; i++)
+            underlying[i] += nn.weightsToHL[feature * HL + i];
+
+        if (primed)
+            childValues->addPiece(WHITE, piece, sq);
     }
 
     while (blackPieces) {
-        const Square sq = popLSB(blackPieces);
+        const Square    sq    = popLSB(blackPieces);
+        const PieceType piece = board.getPiece(sq);
+
+        const usize feature = PolicyNN<HL, ACTIVATION>::feature(board.stm, BLACK, piece, sq);
 
-        const usize feature = PolicyNN::feature(board.stm, BLACK, board.getPiece(sq), sq);
+        for (usize i = 0; i < HL; i++)
+            underlying[i] += nn.weightsToHL[feature * HL + i];
 
-        for (usize i = 0; i < HL_SIZE_P; i++)
-            underlying[i] += nn.weightsToHL[feature * HL_SIZE_P + i];
+        if (primed)
+            childValues->addPiece(BLACK, piece, sq);
     }
 
     for (i16& i : underlying) {
-        if constexpr (ACTIVATION_P == ::ReLU)
-            i = PolicyNN::ReLU(i);
-        if constexpr (ACTIVATION_P == ::CReLU)
-            i = PolicyNN::CReLU(i);
-        if constexpr (ACTIVATION_P == ::SCReLU)
-            i = PolicyNN::SCReLU(i);
+        if constexpr (ACTIVATION == ::ReLU)
+            i = PolicyNN<HL, ACTIVATION>::ReLU(i);
+        if constexpr (ACTIVATION == ::CReLU)
+            i = PolicyNN<HL, ACTIVATION>::CReLU(i);
+        if constexpr (ACTIVATION == ::SCReLU)
+            i = PolicyNN<HL, ACTIVATION>::SCReLU(i);
     }
 }
 
-i16 PolicyNN::ReLU(const i16 x) {
+template<usize HL, int ACTIVATION>
+i16 PolicyNN<HL, ACTIVATION>::ReLU(const i16 x) {
     if (x < 0)
         return 0;
     return x;
 }
 
-i16 PolicyNN::CReLU(const i16 x) { return std::clamp<i16>(x, 0, Q_P); }
+template<usize HL, int ACTIVATION>
+i16 PolicyNN<HL, ACTIVATION>::CReLU(const i16 x) { return std::clamp<i16>(x, 0, Q_P); }
 
-i32 PolicyNN::SCReLU(const i16 x) {
+template<usize HL, int ACTIVATION>
+i32 PolicyNN<HL, ACTIVATION>::SCReLU(const i16 x) {
     if (x < 0)
         return 0;
     if (x > Q_P)
@@ -101,7 +129,8 @@ i32 PolicyNN::SCReLU(const i16 x) {
 }
 
 // Finds the input feature
-usize PolicyNN::feature(const Color stm, const Color pieceColor, const PieceType piece, const Square square) {
+template<usize HL, int ACTIVATION>
+usize PolicyNN<HL, ACTIVATION>::feature(const Color stm, const Color pieceColor, const PieceType piece, const Square square) {
     const bool enemy       = stm != pieceColor;
     const int  squareIndex = (stm == BLACK) ? flipRank(square) : static_cast<int>(square);
 
@@ -141,20 +170,24 @@ usize moveIdx(const Color stm, const Move m) {
     return OFFSETS[from] + static_cast<usize>(popcount(below));
 }
 
-float policyScore(const Color stm, const PolicyAccumulator& policyAccumulator, const Move m) {
+template<usize HL, int ACTIVATION>
+float PolicyNN<HL, ACTIVATION>::policyScore(const Color stm, const PolicyAccumulator<HL>& policyAccumulator, const Move m) const {
     using namespace simd;
-    static_assert(HL_SIZE_P % VECTOR_SIZE<i16> == 0, "Policy HL size is not compatible with the size of this CPU's native register");
+    static_assert(HL % VECTOR_SIZE<i16> == 0, "Policy HL size is not compatible with the size of this CPU's native register");
+
+    // SCReLU squares the accumulator, which adds another factor of Q_P
+    constexpr i32 SCALE = ACTIVATION == ::SCReLU ? Q_P * Q_P * Q_P : Q_P * Q_P;
 
     const usize idx = moveIdx(stm, m);
 
     Vector<i32> outputAccumulator{};
 
-    for (usize i = 0; i < HL_SIZE_P; i += VECTOR_SIZE<i16>) {
+    for (usize i = 0; i < HL; i += VECTOR_SIZE<i16>) {
         // Load values
         const Vector<i16> accumValues = load_ep<i16>(&policyAccumulator[i]);
 
         // Load weights
-        const Vector<i16> weights = load_ep<i8, i16>(&nn.weightsToOut[idx][i]);
+        const Vector<i16> weights = load_ep<i8, i16>(&weightsToOut[idx][i]);
 
         // Apply weights
         const Vector<i32> weighted = madd_epi16(accumValues, weights);
@@ -162,30 +195,123 @@ float policyScore(const Color stm, const PolicyAccumulator& policyAccumulator, c
         outputAccumulator = add_ep<i32>(outputAccumulator, weighted);
     }
 
-    return static_cast<float>(reduce_ep<i32>(outputAccumulator) + nn.outputBiases[idx]) / (Q_P * Q_P);
+    return static_cast<float>(reduce_ep<i32>(outputAccumulator) + outputBiases[idx]) / SCALE;
+}
+
+template<usize HL, int ACTIVATION>
+void PolicyNN<HL, ACTIVATION>::logits(const Board& board, const MoveList& moves, vector<float>& scores, ValueCache* childValues) const {
+    const PolicyAccumulator<HL> accum(*this, board, childValues);
+
+    scores.clear();
+    scores.reserve(moves.length);
+    for (const Move m : moves)
+        scores.push_back(policyScore(board.stm, accum, m));
+}
+
+// A compiled in architecture, called through the type erased network it is used with
+struct PolicyArchitecture {
+    const char* name;
+    usize       size;
+    void (*logits)(const void* network, const Board& board, const MoveList& moves, vector<float>& scores, ValueCache* childValues);
+};
+
+template<usize HL, int ACTIVATION>
+constexpr PolicyArchitecture makePolicyArchitecture(const char* name) {
+    using Network = PolicyNN<HL, ACTIVATION>;
+    return { name, sizeof(Network), [](const void* network, const Board& board, const MoveList& moves, vector<float>& scores, ValueCache* childValues) {
+                static_cast<const Network*>(network)->logits(board, moves, scores, childValues);
+            } };
 }
 
-void fillPolicy(const Board& board, Tree& tree, const SearcherData* searcherData, Node& parent, const float initialTemp, const float endgameTemp) {
-    const PolicyAccumulator accum(board);
+// The embedded network's architecture comes first
+constexpr array POLICY_ARCHITECTURES = { makePolicyArchitecture<HL_SIZE_P, ACTIVATION_P>("2048crelu"),
+                                         makePolicyArchitecture<1024, CReLU>("1024crelu"),
+                                         makePolicyArchitecture<512, CReLU>("512crelu"),
+                                         makePolicyArchitecture<256, SCReLU>("256screlu") };
+
+const PolicyNN<HL_SIZE_P, ACTIVATION_P> nn = *reinterpret_cast<const PolicyNN<HL_SIZE_P, ACTIVATION_P>*>(gPOLICYData);
+
+// The network in use, changed only while no search is running
+NetworkFile               loadedPolicyNetwork;
+const PolicyArchitecture* activePolicyArchitecture = &POLICY_ARCHITECTURES[0];
+const void*               activePolicyNetwork      = &nn;
+string                    activePolicyName         = POLICY_ARCHITECTURES[0].name;
+
+vector<string> policyArchitectures() {
+    vector<string> names;
+    for (const PolicyArchitecture& arch : POLICY_ARCHITECTURES)
+        names.emplace_back(arch.name);
+    return names;
+}
+
+bool setPolicyNetwork(const string& arch, const string& path) {
+    const auto found = std::ranges::find_if(POLICY_ARCHITECTURES, [&](const PolicyArchitecture& a) { return arch == a.name; });
+    if (found == POLICY_ARCHITECTURES.end())
+        return false;
+
+    if (path.empty()) {
+        if (found != POLICY_ARCHITECTURES.begin())
+            return false;
+        activePolicyNetwork = &nn;
+        loadedPolicyNetwork.close();
+    }
+    else {
+        if (!loadedPolicyNetwork.load(path, found->size))
+            return false;
+        activePolicyNetwork = loadedPolicyNetwork.data();
+    }
+
+    activePolicyArchitecture = &*found;
+    activePolicyName         = path.empty() ? arch : arch + " " + path;
+    return true;
+}
+
+string policyNetworkName() { return activePolicyName; }
+
+void benchPolicyNetworks(const std::span<const Board> boards) {
+    constexpr usize REPEATS = 20;
+
+    vector<MoveList> moves(boards.size());
+    usize            moveCount = 0;
+    for (usize idx = 0; idx < boards.size(); idx++) {
+        moves[idx] = Movegen::generateMoves(boards[idx]);
+        moveCount += moves[idx].length;
+    }
+
+    vector<float> scores;
+
+    for (const PolicyArchitecture& arch : POLICY_ARCHITECTURES) {
+        // Other architectures run with zeroed weights, which are just as fast
+        NetworkFile zeroed;
+        const void* network = &arch == activePolicyArchitecture ? activePolicyNetwork : nullptr;
+        if (!network) {
+            zeroed.zero(arch.size);
+            network = zeroed.data();
+        }
+
+        Stopwatch<std::chrono::microseconds> stopwatch;
+        for (usize rep = 0; rep < REPEATS; rep++)
+            for (usize idx = 0; idx < boards.size(); idx++)
+                arch.logits(network, boards[idx], moves[idx], scores, nullptr);
+        const u64 time = std::max<u64>(stopwatch.elapsed(), 1);
+
+        cout << "policy " << arch.name << ": " << boards.size() * REPEATS * 1'000'000 / time << " positions/s, " << moveCount * REPEATS * 1'000'000 / time << " moves/s" << endl;
+    }
+}
+
+template<typename Concurrency>
+float movePolicies(const Board& board, const BasicSearcherData<Concurrency>* searcherData, const MoveList& moves, const float initialTemp, const float endgameTemp, vector<float>& policies, ValueCache* childValues) {
+    activePolicyArchitecture->logits(activePolicyNetwork, board, moves, policies, childValues);
 
     float maxScore = -std::numeric_limits<float>::infinity();
     float sum      = 0;
 
-    vector<float> scores;
-    scores.reserve(parent.numChildren);
-
-    Node*       firstChild = &tree[parent.firstChild.load()];
-    const Node* end        = firstChild + parent.numChildren.load();
-
-    // Get raw scores and find max
-    // and add the butterfly history
-    // to the raw logits
-    for (const Node* node = firstChild; node != end; node++) {
-        const Move  move         = node->move.load();
-        const float historyBonus = searcherData ? (static_cast<float>(searcherData->history.getEntry(board.stm, move)) / BUTTERFLY_POLICY_DIVISOR) : 0;
-        const float score        = policyScore(board.stm, accum, move) + historyBonus;
-        scores.push_back(score);
-        maxScore = std::max(score, maxScore);
+    // Find max and add the butterfly
+    // history to the raw logits
+    for (usize idx = 0; idx < moves.length; idx++) {
+        const float historyBonus = searcherData ? (static_cast<float>(searcherData->history.getEntry(board.stm, moves.moves[idx])) / BUTTERFLY_POLICY_DIVISOR) : 0;
+        policies[idx] += historyBonus;
+        maxScore = std::max(policies[idx], maxScore);
     }
 
     // Calculate the material phase
@@ -194,7 +320,7 @@ void fillPolicy(const Board& board, Tree& tree, const SearcherData* searcherData
 
     // Exponentiate and sum
     const float tempMult = 1 / adjustedTemp;
-    for (float& score : scores) {
+    for (float& score : policies) {
         score = std::exp((score - maxScore) * tempMult);
         sum += score;
     }
@@ -203,12 +329,61 @@ void fillPolicy(const Board& board, Tree& tree, const SearcherData* searcherData
 
     // Normalize
     const float sumMult = 1 / sum;
-    for (usize idx = 0; idx < scores.size(); idx++) {
-        const float score = scores[idx] * sumMult;
-        (firstChild + idx)->policy.store(score);
-
+    for (float& score : policies) {
+        score *= sumMult;
         sumOfSquares += score * score;
     }
 
-    parent.giniImpurity = std::clamp<float>(1 - sumOfSquares, 0, 1);
+    return std::clamp<float>(1 - sumOfSquares, 0, 1);
+}
+
+template<typename Concurrency>
+void fillPolicy(const Board& board, BasicTree<Concurrency>& tree, const BasicSearcherData<Concurrency>* searcherData, BasicNode<Concurrency>& parent, const float initialTemp, const float endgameTemp, ValueCache* childValues) {
+    BasicNode<Concurrency>* firstChild  = &tree[parent.firstChild.load()];
+    const usize             numChildren = parent.numChildren;
+
+    MoveList moves;
+    for (usize idx = 0; idx < numChildren; idx++)
+        moves.add(firstChild[idx].move);
+
+    vector<float> policies;
+    parent.giniImpurity = movePolicies(board, searcherData, moves, initialTemp, endgameTemp, policies, childValues);
+
+    for (usize idx = 0; idx < numChildren; idx++)
+        firstChild[idx].policy.store(policies[idx]);
+
+    // Children are kept in descending policy order, which lets selection
+    // stop scanning once no later child can have a higher PUCT score
+    const Move pvMove = firstChild[parent.pvChild.load()].move;
+
+    vector<BasicNode<Concurrency>> sorted(firstChild, firstChild + numChildren);
+    std::stable_sort(sorted.begin(), sorted.end(), [](const BasicNode<Concurrency>& a, const BasicNode<Concurrency>& b) { return a.policy.load() > b.policy.load(); });
+
+    for (usize idx = 0; idx < numChildren; idx++) {
+        firstChild[idx] = sorted[idx];
+        if (sorted[idx].move.load() == pvMove)
+            parent.pvChild = idx;
+    }
+}
+
+template float movePolicies(const Board&, const BasicSearcherData<SingleThreaded>*, const MoveList&, float, float, vector<float>&, ValueCache*);
+template float movePolicies(const Board&, const BasicSearcherData<MultiThreaded>*, const MoveList&, float, float, vector<float>&, ValueCache*);
+template void  fillPolicy(const Board&, BasicTree<SingleThreaded>&, const BasicSearcherData<SingleThreaded>*, BasicNode<SingleThreaded>&, float, float, ValueCache*);
+template void  fillPolicy(const Board&, BasicTree<MultiThreaded>&, const BasicSearcherData<MultiThreaded>*, BasicNode<MultiThreaded>&, float, float, ValueCache*);
+
+void policyPriors(const Board& board, const MoveList& moves, vector<float>& priors) {
+    activePolicyArchitecture->logits(activePolicyNetwork, board, moves, priors, nullptr);
+
+    float maxScore = -std::numeric_limits<float>::infinity();
+    for (const float score : priors)
+        maxScore = std::max(score, maxScore);
+
+    float sum = 0;
+    for (float& score : priors) {
+        score = std::exp(score - maxScore);
+        sum += score;
+    }
+
+    for (float& score : priors)
+        score /= sum;
 }
\ No newline at end of file
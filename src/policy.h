@@ -1,13 +1,36 @@
 #pragma once
 
+#include "eval.h"
 #include "node.h"
 #include "searcher.h"
 
+#include <span>
+
 // ************ POLICY NETWORK CONFIG ************
 constexpr i16   Q_P       = 128;
 constexpr usize HL_SIZE_P = 2048;
 
 constexpr int ACTIVATION_P = CReLU;
 
-void initPolicy();
-void fillPolicy(const Board& board, Tree& tree, const SearcherData* searcherData, Node& parent, float initialTemp, float endgameTemp);
\ No newline at end of file
+void  initPolicy();
+// Softmaxed policy of each move with the history bonus and temperature
+// Returns the gini impurity of the distribution
+// childValues is primed for evaluating the board's children when given
+template<typename Concurrency>
+float movePolicies(const Board& board, const BasicSearcherData<Concurrency>* searcherData, const MoveList& moves, float initialTemp, float endgameTemp, vector<float>& policies, ValueCache* childValues = nullptr);
+template<typename Concurrency>
+void fillPolicy(const Board& board, BasicTree<Concurrency>& tree, const BasicSearcherData<Concurrency>* searcherData, BasicNode<Concurrency>& parent, float initialTemp, float endgameTemp, ValueCache* childValues = nullptr);
+// Softmaxed policy of each move, without any tree or history
+void  policyPriors(const Board& board, const MoveList& moves, vector<float>& priors);
+
+// Hidden layer sizes and activations compiled in, named like "2048crelu"
+// The embedded network uses HL_SIZE_P and ACTIVATION_P
+vector<string> policyArchitectures();
+// Use the network of the given architecture from the file, or the embedded
+// network when the file is empty. Returns false and keeps the current
+// network if the architecture is unknown or the file doesn't match it
+bool   setPolicyNetwork(const string& arch, const string& path);
+string policyNetworkName();
+
+// Measures scoring speed of every policy architecture
+void benchPolicyNetworks(std::span<const Board> boards);
\ No newline at end of file
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "types.h"
+
+#include <chrono>
+#include <thread>
+
+// Hands snapshots of a running search to a reporting thread without locks
+// The search only fills the snapshot after the reporter asked for one, and
+// the reporter only reads it once it is marked ready, so the two never touch
+// it at the same time and the search never waits on the reporter
+template<typename Snapshot>
+class SnapshotExchange {
+    Snapshot     snapshot;
+    atomic<bool> requested;
+    atomic<bool> ready;
+
+   public:
+    SnapshotExchange() {
+        requested = false;
+        ready     = false;
+    }
+
+    // Called by the search once per iteration, fills the snapshot if one is wanted
+    template<typename Fill>
+    void serve(const Fill& fill) {
+        if (!requested.load(std::memory_order_acquire))
+            return;
+
+        requested.store(false, std::memory_order_relaxed);
+        fill(snapshot);
+        ready.store(true, std::memory_order_release);
+    }
+
+    // Called by the reporter, asks for a snapshot and waits for it
+    // Returns nullptr if stop was set before the search served one
+    const Snapshot* take(const atomic<bool>& stop) {
+        ready.store(false, std::memory_order_relaxed);
+        requested.store(true, std::memory_order_release);
+
+        while (!ready.load(std::memory_order_acquire)) {
+            if (stop.load(std::memory_order_relaxed))
+                return nullptr;
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+        return &snapshot;
+    }
+};
\ No newline at end of file
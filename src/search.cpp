@@ -1,11 +1,17 @@
 #include "datagen.h"
+#include "searchconfig.h"
 #include "searcher.h"
 #include "globals.h"
 #include "movegen.h"
 #include "policy.h"
 #include "eval.h"
+#include "timeman.h"
+#include "reporter.h"
+#include "simd.h"
 
 #include <cmath>
+#include <numeric>
+#include <mutex>
 
 // This file aims to implement the 4 main steps to MCTS search
 // 1 - SELECTION  - Select a node to expand
@@ -15,10 +21,15 @@
 
 
 // ======================== HELPERS ========================
-// Get the state of a position
-RawGameState stateOf(const Board& board, const vector<u64>& posHistory) {
+// Get the state of a position, proven by the tablebases when they cover it
+GameState stateOf(const Board& board, const vector<u64>& posHistory, const Tablebases* tablebases) {
     if (board.isDraw(posHistory))
         return DRAW;
+    if (tablebases != nullptr && tablebases->isOpen()) {
+        const GameState state = tablebases->probe(board);
+        if (state.state() != ONGOING)
+            return state;
+    }
     if (Movegen::generateMoves(board).length == 0) {
         if (board.inCheck())
             return LOSS;
@@ -27,43 +38,39 @@ RawGameState stateOf(const Board& board, const vector<u64>& posHistory) {
     return ONGOING;
 }
 
-float getAdjustedScore(const Node& node) {
-    const RawGameState s = node.state.load().state();
+// Proven wins score above 1 and proven losses below -1 so
+// they always sort past unproven nodes, with shorter wins
+// and longer losses preferred
+template<typename Concurrency>
+float getAdjustedScore(const BasicNode<Concurrency>& node) {
+    const GameState    state = node.state.load();
+    const RawGameState s     = state.state();
 
     if (s == DRAW)
         return 0;
     if (s == WIN)
-        return 1;
+        return 1 + 1.0f / (state.distance() + 1);
     if (s == LOSS)
-        return -1;
+        return -1 - 1.0f / (state.distance() + 1);
     if (node.visits.load() > 0)
         return node.getScore();
     return 0;
 }
 
 // Find the PV (best Q) move for a node
-Move findPvMove(const Tree& tree, const Node& node) {
-    const Node* child = &tree[node.firstChild.load()];
-
-    float bestScore = -getAdjustedScore(*child);
-    Move  bestMove  = child->move;
-    for (usize idx = 1; idx < node.numChildren; idx++) {
-        const float score = -getAdjustedScore(child[idx]);
-        if (score > bestScore) {
-            bestScore = score;
-            bestMove  = child[idx].move;
-        }
-    }
-
-    return bestMove;
+template<typename Concurrency>
+Move findPvMove(const BasicTree<Concurrency>& tree, const BasicNode<Concurrency>& node) {
+    const BasicNode<Concurrency>* child = &tree[node.firstChild.load()];
+    return child[node.pvChild.load()].move;
 }
 
 // Search the tree for the PV line
 // This function will search across halves
-MoveList findPV(const Tree& tree, const Node* initialNode = nullptr) {
+template<typename Concurrency>
+MoveList findPV(const BasicTree<Concurrency>& tree, const BasicNode<Concurrency>* initialNode = nullptr) {
     MoveList pv{};
 
-    const Node* node;
+    const BasicNode<Concurrency>* node;
     if (initialNode == nullptr)
         node = &tree.root();
     else {
@@ -72,108 +79,271 @@ MoveList findPV(const Tree& tree, const Node* initialNode = nullptr) {
     }
 
     while (node->numChildren != 0) {
-        const NodeIndex startIdx  = node->firstChild.load();
-        const Node*     child     = &tree[startIdx];
-        const Node*     bestChild = child;
-        float           bestScore = -getAdjustedScore(*child);
-        for (usize idx = 1; idx < node->numChildren; idx++) {
-            const float score = -getAdjustedScore(child[idx]);
-            if (score > bestScore) {
-                bestScore = score;
-                bestChild = child + idx;
+        node = &tree[node->firstChild.load()] + node->pvChild.load();
+        pv.add(node->move);
+    }
+
+    return pv;
+}
+
+// Keep a node's cached best child up to date after one of its children changed
+// Only a drop in the score of the cached best child needs a full rescan
+template<typename Concurrency>
+void updatePvChild(const BasicTree<Concurrency>& tree, BasicNode<Concurrency>& node, const BasicNode<Concurrency>& changedChild, const float previousScore) {
+    const BasicNode<Concurrency>* child   = &tree[node.firstChild.load()];
+    const u8                      changed = &changedChild - child;
+    const u8                      best    = node.pvChild.load();
+    const float                   score   = -getAdjustedScore(changedChild);
+
+    if (changed == best) {
+        if (score >= previousScore)
+            return;
+
+        u8    bestIdx   = 0;
+        float bestScore = -getAdjustedScore(*child);
+        for (usize idx = 1; idx < node.numChildren; idx++) {
+            const float childScore = -getAdjustedScore(child[idx]);
+            if (childScore > bestScore) {
+                bestScore = childScore;
+                bestIdx   = idx;
             }
         }
-
-        pv.add(bestChild->move);
-        node = bestChild;
+        node.pvChild = bestIdx;
     }
+    else if (score > -getAdjustedScore(child[best]) || (score == -getAdjustedScore(child[best]) && changed < best))
+        node.pvChild = changed;
+}
 
-    return pv;
+// Rank the root's children for MultiPV output
+template<typename Concurrency>
+void rebuildRootTop(BasicTree<Concurrency>& tree, const usize multiPV) {
+    const BasicNode<Concurrency>& root = tree.root();
+    tree.rootTop.rebuild(&tree[root.firstChild.load()], root.numChildren, multiPV, [](const BasicNode<Concurrency>& n) { return -getAdjustedScore(n); });
 }
 
 
 // ======================== SELECTION ========================
 // Return the parent portion of the PUCT score
-float parentPuct(const Node& parent, const float cpuct) { return cpuct * std::sqrt(static_cast<float>(parent.visits + 1)); }
-
-// Return the PUCT score of a node
-float puct(const float parentScore, const float parentQ, const Node& child) {
-    // V + C * P * (N.max(1).sqrt() / (n + 1))
-    // V = Q = total score / visits
-    // C = CPUCT
-    // P = move policy score
-    // N = parent visits
-    // n = child visits
-    const u64 v = child.visits.load();
-    return (v > 0 ? -child.getScore() : parentQ - FPU_SHARPNESS_MARGIN / 10'000.0f) + child.policy * parentScore / (v + 1);
-}
-
-float computeCpuct(const Node& node, const SearchParameters& params) {
-    float cpuct = node.move.load().isNull() ? (inDatagen ? datagen::ROOT_CPUCT : ROOT_CPUCT / 10'000.0f) : (inDatagen ? datagen::CPUCT : CPUCT / 10'000.0f);
-    cpuct *= 1.0f + std::log((node.visits.load() + CPUCT_VISIT_SCALE) / 8192.0f);
-    cpuct *= std::clamp<float>(GINI_BASE / 10'000.0f - GINI_SCALAR * std::log(node.giniImpurity.load() + 0.001f)  / 10'000.0f, GINI_MIN / 10'000.0f, GINI_MAX / 10'000.0f);
+template<typename Concurrency>
+float parentPuct(const BasicNode<Concurrency>& parent, const float cpuct) { return cpuct * std::sqrt(static_cast<float>(parent.visits + 1)); }
+
+template<typename Config, typename Concurrency>
+float computeCpuct(const BasicNode<Concurrency>& node) {
+    float cpuct = node.move.load().isNull() ? Config::rootCpuct() : Config::cpuct();
+    cpuct *= 1.0f + std::log((node.visits.load() + Config::cpuctVisitScale()) / 8192.0f);
+    cpuct *= std::clamp<float>(Config::giniBase() - Config::giniScalar() * std::log(node.giniImpurity.load() + 0.001f), Config::giniMin(), Config::giniMax());
     return cpuct;
 }
 
-// Find the best child node from a parent
-Node& findBestChild(Tree& tree, const Node& node, const SearchParameters& params) {
-    const float cpuct       = computeCpuct(node, params);
-    const float parentScore = parentPuct(node, cpuct);
-    const float parentQ     = node.getScore();
-    Node*       bestChild   = &tree[node.firstChild];
-    Node*       child       = bestChild;
-    float       bestScore   = puct(parentScore, parentQ, *child);
-    for (usize idx = 1; idx < node.numChildren; idx++) {
-        const float score = puct(parentScore, parentQ, child[idx]);
-        if (score > bestScore) {
-            bestScore = score;
-            bestChild = child + idx;
-        }
+// Find the best child node from a parent by PUCT score
+// V + C * P * (N.max(1).sqrt() / (n + 1))
+// V = Q = total score / visits
+// C = CPUCT
+// P = move policy score
+// N = parent visits
+// n = child visits
+// Children are scored a vector at a time from the tree's selection lanes,
+// dividing with a refined reciprocal estimate, and the first child with the
+// best score wins
+// Children proven to win for the opponent are never selected. Every
+// other proven child would have proven the parent already, except draws,
+// which stay selectable as they are the value of the best fallback
+// Children are sorted by policy, so the first unvisited child beats every
+// later unvisited one, and a visited child scores at most 1 + P * U / 2
+template<typename Config, typename Concurrency>
+BasicNode<Concurrency>& findBestChild(BasicTree<Concurrency>& tree, const BasicNode<Concurrency>& node) {
+    using namespace simd;
+    constexpr usize LANES   = VECTOR_SIZE<float>;
+    constexpr float NEG_INF = -std::numeric_limits<float>::infinity();
+
+    const float cpuct        = computeCpuct<Config>(node);
+    const float parentScore  = parentPuct(node, cpuct);
+    const float fpu          = node.getScore() - Config::fpuMargin();
+    const float visitedBound = parentScore / 2;
+    const usize numChildren  = node.numChildren;
+
+    const NodeIndex       first  = node.firstChild.load();
+    const SelectionLanes& lanes  = tree.lanes[first.half()];
+    const float*          q      = &lanes.q[first.index()];
+    const float*          policy = &lanes.policy[first.index()];
+    const float*          visits = &lanes.visits[first.index()];
+
+    Vector<i32> laneIdx;
+    for (usize lane = 0; lane < LANES; lane++)
+        laneIdx[lane] = lane;
+
+    Vector<float> bestScores    = set1_ep<float>(NEG_INF);
+    Vector<i32>   bestIndices   = laneIdx;
+    bool          seenUnvisited = false;
+    for (usize base = 0; base < numChildren; base += LANES) {
+        if (seenUnvisited && 1 + policy[base] * visitedBound <= reduce_max_ep<float>(bestScores))
+            break;
+
+        const Vector<float> v         = load_ep<float>(visits + base);
+        const auto          inRange   = laneIdx < static_cast<i32>(numChildren - base);
+        const auto          unvisited = (v == 0.0f) & inRange;
+
+        Vector<float> score = select_ep<float>(v > 0.0f, load_ep<float>(q + base), set1_ep<float>(fpu)) + load_ep<float>(policy + base) * parentScore * rcp_ps(v + 1.0f);
+        score               = select_ep<float>(inRange, score, set1_ep<float>(NEG_INF));
+
+        const auto better = score > bestScores;
+        bestScores        = select_ep<float>(better, score, bestScores);
+        bestIndices       = select_ep<i32>(better, laneIdx + static_cast<i32>(base), bestIndices);
+        seenUnvisited     = seenUnvisited || any_ep(unvisited);
     }
 
-    return *bestChild;
+    usize best = 0;
+    for (usize lane = 1; lane < LANES; lane++)
+        if (bestScores[lane] > bestScores[best] || (bestScores[lane] == bestScores[best] && bestIndices[lane] < bestIndices[best]))
+            best = lane;
+
+    // Every child is lost only when the parent is proven, or when progressive
+    // widening left moves unmaterialized, which searchNode widens to first
+    assert(bestScores[best] > NEG_INF);
+    if (bestScores[best] == NEG_INF)
+        return tree[first];
+
+    return (&tree[first])[bestIndices[best]];
 }
 
 
 // ======================== EXPANSION ========================
+// Middlegame and endgame policy temperatures of a node's children
+template<typename Config>
+std::pair<float, float> policyTemperatures(const bool isRoot) {
+    const float mgTemp = isRoot ? Config::rootPolicyTemperature() : Config::policyTemperature();
+    const float egTemp = isRoot ? Config::egRootPolicyTemperature() : Config::egPolicyTemperature();
+    return { mgTemp, egTemp };
+}
+
+// Number of children a node below the root materializes
+// when progressive widening is enabled
+template<typename Config>
+usize wideningWidth(const u64 visits) { return Config::wideningBase() + static_cast<usize>(Config::wideningScale() * std::sqrt(static_cast<float>(visits))); }
+
 // Expand a node, adding the new nodes to the tree
-void expandNode(Tree& tree, const SearcherData& searcherData, const Board& board, Node& node, u64& currentIndex) {
+// childValues is primed for the children when given
+template<typename Config, typename Concurrency>
+void expandNode(BasicTree<Concurrency>& tree, const BasicSearcherData<Concurrency>& searcherData, const Board& board, BasicNode<Concurrency>& node, u64& currentIndex, ValueCache* childValues) {
     MoveList moves = Movegen::generateMoves(board);
 
     // Mates aren't handled until the simulation/rollout stage
     if (moves.length == 0)
         return;
 
-    if (currentIndex + moves.length >= tree.activeTree().size()) {
+    const bool  isRoot = currentIndex == 1;
+    const usize count  = tree.widening && !isRoot ? std::min<usize>(moves.length, wideningWidth<Config>(node.visits)) : moves.length;
+
+    if (currentIndex + count >= tree.activeTree().size()) {
         tree.switchHalves = true;
         return;
     }
 
     node.firstChild  = { currentIndex, tree.activeHalf() };
-    node.numChildren = moves.length;
+    node.numChildren = count;
+    node.numMoves    = moves.length;
+    node.pvChild     = 0;
+
+    BasicNode<Concurrency>* child = &tree.activeTree()[currentIndex];
+
+    const auto [mgTemp, egTemp] = policyTemperatures<Config>(isRoot);
+
+    if (count == moves.length) {
+        for (usize i = 0; i < moves.length; i++) {
+            child[i].totalScore   = 0;
+            child[i].visits       = 0;
+            child[i].move         = moves[i];
+            child[i].state        = ONGOING;
+            child[i].numChildren  = 0;
+            child[i].giniImpurity = 0;
+        }
 
-    Node* child = &tree.activeTree()[currentIndex];
+        fillPolicy(board, tree, &searcherData, node, mgTemp, egTemp, childValues);
+    }
+    else {
+        // Only the best moves by policy are materialized, the
+        // rest are recomputed if the node is widened later
+        vector<float> policies;
+        node.giniImpurity = movePolicies(board, &searcherData, moves, mgTemp, egTemp, policies, childValues);
+
+        array<u8, 256> order;
+        std::iota(order.begin(), order.begin() + moves.length, 0);
+        std::stable_sort(order.begin(), order.begin() + moves.length, [&](const u8 a, const u8 b) { return policies[a] > policies[b]; });
+
+        for (usize i = 0; i < count; i++) {
+            child[i].totalScore   = 0;
+            child[i].visits       = 0;
+            child[i].move         = moves[order[i]];
+            child[i].policy       = policies[order[i]];
+            child[i].state        = ONGOING;
+            child[i].numChildren  = 0;
+            child[i].giniImpurity = 0;
+        }
+    }
 
-    for (usize i = 0; i < moves.length; i++) {
-        child[i].totalScore   = 0;
-        child[i].visits       = 0;
-        child[i].move         = moves[i];
-        child[i].state        = ONGOING;
-        child[i].numChildren  = 0;
-        child[i].giniImpurity = 0;
+    tree.syncLanes(node);
+    currentIndex += count;
+}
+
+// Materialize more of a node's moves by moving its children to a larger block
+// Existing children keep their statistics, and every child's policy is
+// recomputed, which also refreshes the policy of a reused root
+template<typename Config, typename Concurrency>
+void widenNode(BasicTree<Concurrency>& tree, const BasicSearcherData<Concurrency>& searcherData, const Board& board, BasicNode<Concurrency>& node, u64& currentIndex, const usize width, const bool isRoot, ValueCache* childValues) {
+    const MoveList moves = Movegen::generateMoves(board);
+    const usize    count = std::clamp<usize>(width, node.numChildren, moves.length);
+
+    if (currentIndex + count >= tree.activeTree().size()) {
+        tree.switchHalves = true;
+        return;
     }
 
-    const bool isRoot = currentIndex == 1;
+    const auto [mgTemp, egTemp] = policyTemperatures<Config>(isRoot);
 
-    const float mgTemp = isRoot ? (inDatagen ? datagen::ROOT_POLICY_TEMPERATURE : ROOT_POLICY_TEMPERATURE / 10'000.0f) : (inDatagen ? datagen::POLICY_TEMPERATURE : POLICY_TEMPERATURE / 10'000.0f);
-    const float egTemp = isRoot ? (inDatagen ? datagen::EG_ROOT_POLICY_TEMPERATURE : EG_ROOT_POLICY_TEMPERATURE / 10'000.0f) : (inDatagen ? datagen::EG_POLICY_TEMPERATURE : EG_POLICY_TEMPERATURE / 10'000.0f);
+    vector<float> policies;
+    node.giniImpurity = movePolicies(board, &searcherData, moves, mgTemp, egTemp, policies, childValues);
 
-    fillPolicy(board, tree, &searcherData, node, mgTemp, egTemp);
+    array<u8, 256> order;
+    std::iota(order.begin(), order.begin() + moves.length, 0);
+    std::stable_sort(order.begin(), order.begin() + moves.length, [&](const u8 a, const u8 b) { return policies[a] > policies[b]; });
 
-    currentIndex += moves.length;
+    const BasicNode<Concurrency>* oldChild = &tree[node.firstChild.load()];
+    const BasicNode<Concurrency>* oldEnd   = oldChild + node.numChildren;
+    const Move                    pvMove   = oldChild[node.pvChild.load()].move;
+    BasicNode<Concurrency>*       newChild = &tree.activeTree()[currentIndex];
+
+    usize added    = 0;
+    usize newMoves = count - node.numChildren;
+    for (usize i = 0; i < moves.length && added < count; i++) {
+        const Move                    m        = moves[order[i]];
+        const BasicNode<Concurrency>* existing = std::find_if(oldChild, oldEnd, [&](const BasicNode<Concurrency>& n) { return n.move.load() == m; });
+
+        if (existing != oldEnd)
+            newChild[added] = *existing;
+        else if (newMoves > 0) {
+            newMoves--;
+            newChild[added]      = BasicNode<Concurrency>();
+            newChild[added].move = m;
+        }
+        else
+            continue;
+
+        newChild[added].policy = policies[order[i]];
+        if (m == pvMove)
+            node.pvChild = added;
+        added++;
+    }
+
+    node.firstChild  = { currentIndex, tree.activeHalf() };
+    node.numChildren = count;
+    node.numMoves    = moves.length;
+
+    tree.syncLanes(node);
+    currentIndex += count;
 }
 
-void expandNodeRaw(Tree& tree, const Board& board, Node& node, u64& currentIndex) {
+template<typename Concurrency>
+void expandNodeRaw(BasicTree<Concurrency>& tree, const Board& board, BasicNode<Concurrency>& node, u64& currentIndex) {
     MoveList moves = Movegen::generateMoves(board);
 
     // Mates aren't handled until the simulation/rollout stage
@@ -187,8 +357,10 @@ void expandNodeRaw(Tree& tree, const Board& board, Node& node, u64& currentIndex
 
     node.firstChild  = { currentIndex, tree.activeHalf() };
     node.numChildren = moves.length;
+    node.numMoves    = moves.length;
+    node.pvChild     = 0;
 
-    Node* child = &tree.activeTree()[currentIndex];
+    BasicNode<Concurrency>* child = &tree.activeTree()[currentIndex];
 
     for (usize i = 0; i < moves.length; i++) {
         child[i].totalScore   = 0;
@@ -199,11 +371,13 @@ void expandNodeRaw(Tree& tree, const Board& board, Node& node, u64& currentIndex
         child[i].giniImpurity = 0;
     }
 
-    fillPolicy(board, tree, nullptr, node, 1, 1);
+    fillPolicy<Concurrency>(board, tree, nullptr, node, 1, 1);
+    tree.syncLanes(node);
 }
 
 // Copy children from the inactive half to the current one
-void copyChildren(Tree& tree, Node& node, u64& currentIndex) {
+template<typename Concurrency>
+void copyChildren(BasicTree<Concurrency>& tree, BasicNode<Concurrency>& node, u64& currentIndex) {
     const u8 numChildren = node.numChildren;
 
     if (currentIndex + numChildren > tree.activeTree().size()) {
@@ -211,21 +385,23 @@ void copyChildren(Tree& tree, Node& node, u64& currentIndex) {
         return;
     }
 
-    const Node* oldChild = &tree[node.firstChild.load()];
-    Node*       newChild = &tree.activeTree()[currentIndex];
+    const BasicNode<Concurrency>* oldChild = &tree[node.firstChild.load()];
+    BasicNode<Concurrency>*       newChild = &tree.activeTree()[currentIndex];
 
     for (usize i = 0; i < numChildren; i++)
         newChild[i] = oldChild[i];
 
     node.firstChild.store({ currentIndex, tree.activeHalf() });
 
+    tree.syncLanes(node);
     currentIndex += node.numChildren;
 }
 
 
 // ======================== SIMULATION ========================
 // Evaluate a position
-float evaluateNode(const Tree& tree, const Node& node, const Board& board) {
+template<typename Concurrency>
+float evaluateNode(const BasicTree<Concurrency>& tree, const BasicNode<Concurrency>& node, const Board& board, ValueCache& valueCache) {
     const RawGameState s = node.state.load().state();
 
     if (s == DRAW)
@@ -239,15 +415,43 @@ float evaluateNode(const Tree& tree, const Node& node, const Board& board) {
     if (entry.key == board.zobrist)
         return entry.q;
 
-    return cpToWDL(evaluate(board));
+    if (tree.experience.isOpen())
+        if (const ExperienceEntry* stored = tree.experience.probe(board.zobrist))
+            return stored->q;
+
+    return cpToWDL(evaluate(board, valueCache));
+}
+
+// Merge the positions of the tree with enough visits into the experience file
+// Children never have more visits than their parent, so the walk stops at
+// the first node below the threshold on every line
+template<typename Concurrency>
+void storeExperience(BasicTree<Concurrency>& tree, const BasicNode<Concurrency>& node, const Board& board) {
+    if (node.visits < tree.experience.minVisits || node.isTerminal())
+        return;
+
+    tree.experience.store(board.zobrist, node.visits, node.getScore());
+
+    if (node.numChildren == 0 || node.firstChild.load().half() != tree.activeHalf())
+        return;
+
+    const BasicNode<Concurrency>* child = &tree[node.firstChild.load()];
+    for (usize idx = 0; idx < node.numChildren; idx++) {
+        if (child[idx].visits < tree.experience.minVisits)
+            continue;
+        Board next = board;
+        next.move(child[idx].move.load());
+        storeExperience(tree, child[idx], next);
+    }
 }
 
 // Remove all references to the other half
-void removeRefs(Tree& tree, Node& node) {
+template<typename Concurrency>
+void removeRefs(BasicTree<Concurrency>& tree, BasicNode<Concurrency>& node) {
     const NodeIndex startIdx = node.firstChild.load();
 
     if (startIdx.half() == tree.activeHalf()) {
-        Node* child = &tree[startIdx];
+        BasicNode<Concurrency>* child = &tree[startIdx];
         for (usize idx = 0; idx < +node.numChildren; idx++)
             removeRefs(tree, child[idx]);
     }
@@ -255,28 +459,147 @@ void removeRefs(Tree& tree, Node& node) {
         node.numChildren = 0;
 }
 
+// ======================== TREE REUSE ========================
+// Find the node of a position within two plies of the last root
+template<typename Concurrency>
+BasicNode<Concurrency>* findReusableNode(BasicTree<Concurrency>& tree, const Board& oldRoot, const Board& newRoot) {
+    BasicNode<Concurrency>& root = tree.root();
+    if (oldRoot.zobrist == newRoot.zobrist)
+        return &root;
+
+    BasicNode<Concurrency>* child = &tree[root.firstChild.load()];
+
+    for (usize idx = 0; idx < root.numChildren; idx++) {
+        Board afterChild = oldRoot;
+        afterChild.move(child[idx].move);
+        if (afterChild.zobrist == newRoot.zobrist)
+            return child + idx;
+
+        BasicNode<Concurrency>* grandchild = &tree[child[idx].firstChild.load()];
+        for (usize i = 0; i < child[idx].numChildren; i++) {
+            Board afterGrandchild = afterChild;
+            afterGrandchild.move(grandchild[i].move);
+            if (afterGrandchild.zobrist == newRoot.zobrist)
+                return grandchild + i;
+        }
+    }
+
+    return nullptr;
+}
+
+// Make the subtree of the new root position the root of the tree, using
+// the same steps as a half switch so the rest of the old tree is dropped
+// Returns false if the position wasn't searched last time
+template<typename Concurrency>
+bool reuseTree(BasicTree<Concurrency>& tree, const BasicSearcherData<Concurrency>& searcherData, const Board& oldRoot, const Board& newRoot, u64& currentIndex) {
+    if (tree.root().numChildren == 0)
+        return false;
+
+    BasicNode<Concurrency>* const found = findReusableNode(tree, oldRoot, newRoot);
+    if (found == nullptr || found->visits == 0)
+        return false;
+
+    BasicNode<Concurrency> newRootNode = *found;
+    newRootNode.move                   = Move::null();
+    // Proofs depend on the path, they are redone from the children
+    newRootNode.state = ONGOING;
+    // Children in the inactive half would be overwritten after the switch
+    if (newRootNode.firstChild.load().half() != tree.activeHalf())
+        newRootNode.numChildren = 0;
+
+    removeRefs(tree, tree.root());
+    tree.inactiveTree()[0] = newRootNode;
+    tree.switchHalf();
+    currentIndex = 1;
+
+    // The children were expanded away from the root, so their policy is
+    // recomputed with the root temperature and every move is materialized
+    if (newRootNode.numChildren > 0)
+        widenNode<PlayConfig>(tree, searcherData, newRoot, tree.root(), currentIndex, INF_U64, true, nullptr);
+
+    return true;
+}
+
+// ======================== SOLVER ========================
+// Try to prove a node after one of its children has been proven
+// The node is a win as soon as any child is a loss, otherwise it is
+// only proven once every child is, as a draw if any child draws and
+// as a loss (taking the longest line) if every child wins
+template<typename Concurrency>
+void proveNode(const BasicTree<Concurrency>& tree, BasicNode<Concurrency>& node, const BasicNode<Concurrency>& provenChild) {
+    constexpr u16 MAX_DISTANCE = 0b0011111111111111;
+
+    const GameState childState = provenChild.state.load();
+    if (childState.state() == LOSS) {
+        node.state = GameState(WIN, std::min<u16>(childState.distance() + 1, MAX_DISTANCE));
+        return;
+    }
+
+    // Moves that aren't materialized are unproven
+    if (node.numChildren < node.numMoves)
+        return;
+
+    const BasicNode<Concurrency>* child       = &tree[node.firstChild.load()];
+    bool                          anyDraw     = false;
+    u16                           longestLoss = 0;
+
+    for (usize idx = 0; idx < node.numChildren; idx++) {
+        const GameState s = child[idx].state.load();
+        if (s.state() == ONGOING)
+            return;
+        if (s.state() == LOSS) {
+            node.state = GameState(WIN, std::min<u16>(s.distance() + 1, MAX_DISTANCE));
+            return;
+        }
+
+        if (s.state() == DRAW)
+            anyDraw = true;
+        else
+            longestLoss = std::max<u16>(longestLoss, std::min<u16>(s.distance() + 1, MAX_DISTANCE));
+    }
+
+    node.state = anyDraw ? GameState(DRAW) : GameState(LOSS, longestLoss);
+}
+
+
 // A recursive implementation of the MCTS algorithm
 // based on implementations from Monty and Jackal
-float searchNode(Tree&                   tree,
-                 Node&                   node,
-                 SearcherData&           searcherData,
-                 const Board&            board,
-                 u64&                    currentIndex,
-                 u64&                    seldepth,
-                 RelaxedAtomic<u64>&     cumulativeDepth,
-                 vector<u64>&            posHistory,
-                 const SearchParameters& params,
-                 const usize             ply) {
+template<typename Config, typename Concurrency>
+float searchNode(BasicTree<Concurrency>&         tree,
+                 BasicNode<Concurrency>&         node,
+                 BasicSearcherData<Concurrency>& searcherData,
+                 ValueCache&                     valueCache,
+                 const Board&                    board,
+                 u64&                            currentIndex,
+                 u64&                            seldepth,
+                 RelaxedAtomic<u64>&             cumulativeDepth,
+                 vector<u64>&                    posHistory,
+                 const SearchParameters&         params,
+                 const usize                     ply) {
     float score;
 
+    // A repetition along the path is scored by the path, so its
+    // statistics can't be shared with other move orders
+    const bool shared = tree.graph && std::ranges::count(posHistory, board.zobrist) <= 1;
+
+    const HashTableEntry& entry = tree.tt.getEntry(board.zobrist);
+
+    // If the position has been searched more through another move order than through
+    // this edge, the edge is caught up with the shared value instead of being searched again
+    bool catchUp = shared && ply > 0 && node.visits > 0 && !node.isTerminal() && entry.key == board.zobrist && entry.visits > node.visits;
+
     // If the node is terminal (W/D/L) then return the score right away
     if (node.isTerminal())
-        score = evaluateNode(tree, node, board);
+        score = evaluateNode(tree, node, board, valueCache);
+    else if (catchUp)
+        score = entry.q;
     // Otherwise if the node is being visited for the first time, set the state, then backprop
     // either the state's score or the NN's score
     else if (node.visits == 0) {
-        node.state.store(stateOf(board, posHistory));
-        score = evaluateNode(tree, node, board);
+        // The root is only proven through its moves, so it still has one to play
+        node.state.store(stateOf(board, posHistory, ply > 0 ? &tree.tablebases : nullptr));
+        score   = evaluateNode(tree, node, board, valueCache);
+        catchUp = shared && ply > 0 && !node.isTerminal() && entry.key == board.zobrist;
     }
     else {
         const bool inCurrentHalf = node.firstChild.load().half() == tree.activeHalf();
@@ -284,7 +607,13 @@ float searchNode(Tree&                   tree,
 
         // If the node has no children, expand it
         if (numChildren == 0)
-            expandNode(tree, searcherData, board, node, currentIndex);
+            expandNode<Config>(tree, searcherData, board, node, currentIndex, &valueCache);
+        // If more moves are due with progressive widening, or it was turned off, materialize
+        // them. The block at least doubles so abandoned blocks stay a fraction of the tree
+        // A node whose materialized children are all lost can't be proven or searched
+        // through them, so it widens however few visits it has
+        else if (numChildren < node.numMoves && (!tree.widening || numChildren < wideningWidth<Config>(node.visits) || tree.childrenLost(node)))
+            widenNode<Config>(tree, searcherData, board, node, currentIndex, tree.widening ? std::max<usize>(wideningWidth<Config>(node.visits), numChildren * 2) : INF_U64, ply == 0, &valueCache);
         // Otherwise, if the node's children are in the other
         // half, copy them across
         else if (!inCurrentHalf && numChildren > 0)
@@ -298,40 +627,76 @@ float searchNode(Tree&                   tree,
 
         // Now that the children are either expanded or in the current half,
         // travel deeper into the tree
-        Node&      bestChild = findBestChild(tree, node, params);
-        const Move m         = bestChild.move.load();
-        Board      newBoard  = board;
+        BasicNode<Concurrency>& bestChild = findBestChild<Config>(tree, node);
+        const Move              m         = bestChild.move.load();
+
+        // Start loading what the child's visit reads first while the move is made
+        if (tree.prefetch) {
+            const u64 childKey = board.keyAfter(m);
+            tree.tt.prefetch(childKey);
+            if (bestChild.numChildren > 0)
+                tree.prefetchChildren(bestChild);
+            else if (bestChild.visits == 0) {
+                if (tree.experience.isOpen())
+                    tree.experience.prefetch(childKey);
+                valueCache.prefetch(board, m);
+            }
+        }
+
+        Board newBoard = board;
         newBoard.move(m);
+        assert(newBoard.zobrist == board.keyAfter(m));
+
+        const float previousScore = -getAdjustedScore(bestChild);
 
         posHistory.push_back(newBoard.zobrist);
-        score = -searchNode(tree, bestChild, searcherData, newBoard, currentIndex, seldepth, cumulativeDepth, posHistory, params, ply + 1);
+        score = -searchNode<Config>(tree, bestChild, searcherData, valueCache, newBoard, currentIndex, seldepth, cumulativeDepth, posHistory, params, ply + 1);
         posHistory.pop_back();
 
+        tree.syncLane(node, &bestChild - &tree[node.firstChild.load()]);
+
         searcherData.history.update(board.stm, m, score);
+
+        if (!tree.switchHalves) {
+            if (bestChild.isTerminal())
+                proveNode(tree, node, bestChild);
+
+            updatePvChild(tree, node, bestChild, previousScore);
+            if (ply == 0)
+                tree.rootTop.update(&tree[node.firstChild.load()], node.numChildren, &bestChild - &tree[node.firstChild.load()], [](const BasicNode<Concurrency>& n) { return -getAdjustedScore(n); });
+        }
     }
 
     if (tree.switchHalves)
         return 0;
 
     // Backprop as the stack unwinds
-    node.totalScore.getUnderlying().fetch_add(score, std::memory_order_relaxed);
-    node.visits.getUnderlying().fetch_add(1, std::memory_order_relaxed);
+    node.addScore(score);
+    node.addVisit();
 
-    cumulativeDepth.getUnderlying().fetch_add(1, std::memory_order_relaxed);
+    Concurrency::add(cumulativeDepth, 1);
     seldepth = std::max(seldepth, ply);
 
-    tree.tt.update(board.zobrist, node.visits, node.getScore());
+    if (!tree.graph)
+        tree.tt.update(board.zobrist, node.visits, node.getScore());
+    else if (shared && !node.isTerminal()) {
+        // Searched edges add new information to the position,
+        // and the edge takes on the value of every path into it
+        if (!catchUp)
+            tree.tt.accumulate(board.zobrist, score);
+        if (entry.key == board.zobrist && entry.visits >= node.visits)
+            node.setScore(entry.q);
+    }
 
     return score;
 }
 
 // The entry point to the main search
-Move Searcher::search(const SearchParameters params, const SearchLimits limits) {
+template<typename Concurrency>
+Move BasicSearcher<Concurrency>::search(const SearchParameters params, const SearchLimits limits) {
     auto& cumulativeDepth = this->nodeCount;
 
-    tree.activeTree()[0]   = Node();
-    tree.inactiveTree()[0] = Node();
-    tree.switchHalves      = false;
+    tree.switchHalves = false;
 
     nodeCount     = 0;
     stopSearching = false;
@@ -341,73 +706,216 @@ Move Searcher::search(const SearchParameters params, const SearchLimits limits)
     u64   halfChanges  = 0;
     usize seldepth     = 0;
 
+    // Keep the subtree of this position if the last search reached it
+    if (inDatagen || !canReuseTree || !reuseTree(tree, *searcherData, lastRoot, rootPos, currentIndex)) {
+        tree.activeTree()[0]   = Node();
+        tree.inactiveTree()[0] = Node();
+    }
+    lastRoot     = rootPos;
+    canReuseTree = true;
+
+    // Ponder searches are rooted before the expected reply, and run
+    // until they are stopped or the reply is played
+    const bool ponderSearch = pondering.load();
+    const bool ponderParent = ponderSearch && !ponderMove.isNull();
+
     const usize multiPV = std::min(::multiPV, Movegen::generateMoves(rootPos).length);
 
     // Time management
-    i64 timeToSpend = limits.mtime ? limits.mtime : (limits.time / 20 + limits.inc / 2);
+    TimeManager timeManager(limits);
+    bool        outOfTime = false;
+
+    const bool infinite = !limits.mate && limits.nodes == 0 && limits.depth == 0 && !timeManager.enabled();
 
-    if (limits.time != 0 || limits.inc != 0)
-        timeToSpend = std::max<i64>(timeToSpend - static_cast<i64>(MOVE_OVERHEAD), 1);
+    const bool logTime = params.doReporting && params.doUci && timeManager.enabled();
+    if (logTime)
+        cout << "info string time soft " << timeManager.soft() << " hard " << timeManager.hard() << endl;
+
+    bool earlyStop = false;
 
     // Returns true if search has met a limit
     const auto stopSearching = [&]() {
-        if (limits.mate && tree.root().state.load().state() != ONGOING)
+        if (pondering.load())
+            return this->stopSearching.load();
+        // Nothing can change once the root is proven
+        if (!infinite && tree.root().isTerminal())
+            return true;
+        if (earlyStop)
             return true;
         const u64 nodeCount = this->nodeCount.load();
-        if (this->stopSearching.load() || (timeToSpend != 0 && static_cast<i64>(limits.commandTime.elapsed()) >= timeToSpend))
+        if (this->stopSearching.load())
+            return true;
+        if (timeManager.shouldStop(static_cast<i64>(limits.commandTime.elapsed()))) {
+            outOfTime = true;
             return true;
+        }
         return (limits.nodes > 0 && nodeCount >= limits.nodes) || (limits.depth > 0 && cumulativeDepth / iterations >= limits.depth);
     };
 
-    // Intervals to report on
-    Stopwatch<std::chrono::milliseconds> stopwatch;
-    RollingWindow<std::pair<u64, Move>>  bestMoves(std::max<int>(getTerminalRows() - 29 - multiPV, 1));
-    usize                                lastDepth    = 0;
-    usize                                lastSeldepth = 0;
-    Move                                 lastMove     = Move::null();
-
-    const auto sortedChildren = [&]() {
-        vector<Node> children;
-        const Node   root  = tree.root();
-        const Node*  child = &tree[root.firstChild];
-        const Node*  end   = child + root.numChildren;
-        children.reserve(root.numChildren);
-        for (const Node* idx = child; idx != end; idx++)
-            children.push_back(*idx);
-
-        std::ranges::sort(children, std::greater{}, [](const Node& n) { return -getAdjustedScore(n); });
-        return children;
+    // Summarises the root for the time manager
+    const auto rootStats = [&]() {
+        const Node  root  = tree.root();
+        const Node* child = &tree[root.firstChild];
+
+        RootStats stats{ findPvMove(tree, root), Move::null(), 0, 0, 0, 0, -std::numeric_limits<float>::infinity() };
+        for (usize idx = 0; idx < root.numChildren; idx++) {
+            const float q = -getAdjustedScore(child[idx]);
+            if (idx == root.pvChild.load())
+                stats.bestQ = q;
+            else
+                stats.secondQ = std::max(stats.secondQ, q);
+
+            const u64 visits = child[idx].visits.load();
+            stats.totalVisits += visits;
+            if (visits > stats.bestVisits) {
+                stats.secondVisits = stats.bestVisits;
+                stats.bestVisits   = visits;
+                stats.mostVisited  = child[idx].move;
+            }
+            else if (visits > stats.secondVisits)
+                stats.secondVisits = visits;
+        }
+        return stats;
     };
 
-    const auto printUCI = [&]() {
-        const auto children = sortedChildren();
-        const u64  time     = limits.commandTime.elapsed();
-
-        for (usize i = 1; i <= multiPV; i++) {
-            const Node&    n  = children[i - 1];
-            const MoveList pv = findPV(tree, &n);
-
-            cout << "info depth " << cumulativeDepth / iterations;
-            cout << " seldepth " << seldepth;
-            cout << " time " << time;
-            cout << " nodes " << nodeCount.load();
-            if (time > 0)
-                cout << " nps " << nodeCount.load() * 1000 / time;
-            cout << " hashfull " << currentIndex * 1000 / tree.activeTree().size();
-            cout << " hswitches " << halfChanges;
+    // The best move is settled once it is also the most visited move and the runner
+    // up could not catch up in visits with the iterations left in the budget
+    // This is a heuristic, the move played is the one with the best Q and a lead in
+    // visits doesn't stop its Q from falling below another move's, so its Q also has
+    // to lead every other move's by a margin
+    const auto bestMoveSettled = [&](const RootStats& stats) {
+        if (infinite || limits.depth > 0 || multiPV > 1 || stats.bestMove != stats.mostVisited)
+            return false;
+        if (stats.bestQ - stats.secondQ < EARLY_STOP_Q_MARGIN / 10'000.0f)
+            return false;
+
+        u64 remaining = INF_U64;
+        if (limits.nodes > 0) {
+            const u64 nodesPerIteration = std::max<u64>(nodeCount.load() / iterations, 1);
+            remaining                   = (limits.nodes - std::min(nodeCount.load(), limits.nodes)) / nodesPerIteration;
+        }
+        if (timeManager.enabled()) {
+            const i64 elapsed = std::max<i64>(limits.commandTime.elapsed(), 1);
+            remaining         = std::min<u64>(remaining, std::max<i64>(timeManager.soft() - elapsed, 0) * iterations / elapsed);
+        }
+
+        return stats.bestVisits - stats.secondVisits > remaining;
+    };
+
+    // Root visits at the last KLD gain check
+    vector<u64> lastRootVisits;
+    u64         lastRootTotal = 0;
+
+    // The KL divergence between the current root visit distribution and the
+    // last one, per visit in between. Returns true once it has converged
+    const auto kldConverged = [&](const RootStats& stats) {
+        const Node  root  = tree.root();
+        const Node* child = &tree[root.firstChild];
+
+        vector<u64> visits(root.numChildren);
+        for (usize idx = 0; idx < root.numChildren; idx++)
+            visits[idx] = child[idx].visits.load();
+
+        bool  converged = false;
+        float kld       = 0;
+        if (lastRootTotal > 0 && lastRootVisits.size() == visits.size() && stats.totalVisits > lastRootTotal) {
+            converged = true;
+            for (usize idx = 0; idx < visits.size(); idx++) {
+                if (visits[idx] == 0)
+                    continue;
+                // A newly visited move means the distribution is still moving
+                if (lastRootVisits[idx] == 0) {
+                    converged = false;
+                    break;
+                }
+                const float p = static_cast<float>(visits[idx]) / stats.totalVisits;
+                const float q = static_cast<float>(lastRootVisits[idx]) / lastRootTotal;
+                kld += p * std::log(p / q);
+            }
+            converged = converged && kld / (stats.totalVisits - lastRootTotal) < datagen::KLD_GAIN_THRESHOLD;
+        }
+
+        lastRootVisits = std::move(visits);
+        lastRootTotal  = stats.totalVisits;
+        return converged;
+    };
+
+    // Reporting runs on its own thread from snapshots the search publishes
+    // when asked, so formatting and output never stall the search
+    struct Snapshot {
+        struct Line {
+            MoveList  pv;
+            GameState state;
+            float     score;
+        };
+
+        u64          depth;
+        u64          seldepth;
+        u64          nodes;
+        u64          elapsed;
+        u64          hashfull;
+        u64          halfChanges;
+        float        halfUsage;
+        float        ttUsage;
+        GameState    rootState;
+        float        rootScore;
+        MoveList     pv;
+        vector<Line> lines;
+    };
+
+    const auto fillSnapshot = [&](Snapshot& snapshot) {
+        const Node& root = tree.root();
+        const Node* child = &tree[root.firstChild];
+
+        snapshot.depth       = cumulativeDepth / std::max<u64>(iterations, 1);
+        snapshot.seldepth    = seldepth;
+        snapshot.nodes       = nodeCount.load();
+        snapshot.elapsed     = limits.commandTime.elapsed();
+        snapshot.hashfull    = currentIndex * 1000 / tree.activeTree().size();
+        snapshot.halfChanges = halfChanges;
+        snapshot.halfUsage   = static_cast<float>(currentIndex) / tree.activeTree().size();
+        snapshot.ttUsage     = params.doUci ? 0 : tree.tt.hashfull();
+        snapshot.rootState   = root.state.load();
+        snapshot.rootScore   = getAdjustedScore(root);
+        snapshot.pv          = findPV(tree);
+
+        snapshot.lines.clear();
+        for (usize i = 0; i < tree.rootTop.size(); i++) {
+            const Node& n = child[tree.rootTop[i]];
+            // The child's state and score are from the opponent's perspective
+            // Children proven before the search may not have been visited
+            snapshot.lines.push_back({ findPV(tree, &n), n.state.load(), -getAdjustedScore(n) });
+        }
+    };
+
+    const auto printUCI = [&](const Snapshot& snapshot) {
+        for (usize i = 1; i <= std::min(multiPV, snapshot.lines.size()); i++) {
+            const auto& line = snapshot.lines[i - 1];
+
+            cout << "info depth " << snapshot.depth;
+            cout << " seldepth " << snapshot.seldepth;
+            cout << " time " << snapshot.elapsed;
+            cout << " nodes " << snapshot.nodes;
+            if (snapshot.elapsed > 0)
+                cout << " nps " << snapshot.nodes * 1000 / snapshot.elapsed;
+            cout << " hashfull " << snapshot.hashfull;
+            cout << " hswitches " << snapshot.halfChanges;
             cout << " multipv " << i;
-            if (n.state.load().state() == ONGOING || n.state.load().state() == DRAW)
-                cout << " score cp " << wdlToCP(-n.getScore());
+            if (line.state.state() == ONGOING || line.state.state() == DRAW)
+                cout << " score cp " << wdlToCP(line.score);
             else
-                cout << " score mate " << (n.state.load().distance() + 1) / 2 * (n.state.load().state() == WIN ? 1 : -1);
+                cout << " score mate " << (line.state.distance() + 2) / 2 * (line.state.state() == LOSS ? 1 : -1);
             cout << " pv";
-            for (Move m : pv)
+            for (Move m : line.pv)
                 cout << " " << m;
-            cout << endl;
+            cout << "\n";
         }
+        cout.flush();
     };
 
-    const auto prettyPrint = [&]() {
+    RollingWindow<std::pair<u64, Move>> bestMoves(std::max<int>(getTerminalRows() - 29 - multiPV, 1));
+
+    const auto prettyPrint = [&](const Snapshot& snapshot) {
         const auto printStat = [&](const string& label, const auto& value, const string& suffix = "") { cout << Colors::GREY << label << Colors::WHITE << value << suffix << "   \n"; };
 
         const auto printBar = [&](const string& label, const float progress) {
@@ -416,46 +924,42 @@ Move Searcher::search(const SearchParameters params, const SearchLimits limits)
             cout << "  \n";
         };
 
-        const MoveList pv        = findPV(tree);
-        const Node     root      = tree.root();
-        const auto     children  = sortedChildren();
-        const u64      elapsedMs = limits.commandTime.elapsed() + 1;
+        const MoveList& pv        = snapshot.pv;
+        const GameState rootState = snapshot.rootState;
+        const u64       elapsedMs = snapshot.elapsed + 1;
 
         cursor::goTo(1, 1);
 
         cout << rootPos.asString(pv[0]) << "\n";
 
         printStat(" Tree Size:    ", (tree.nodes[0].size() + tree.nodes[1].size() + 2) * sizeof(Node) / 1024 / 1024, "MB");
-        printBar(" Half Usage:   ", static_cast<float>(currentIndex) / tree.activeTree().size());
+        printBar(" Half Usage:   ", snapshot.halfUsage);
         printStat(" TT Size:      ", (tree.tt.size + 1) * sizeof(HashTableEntry) / 1024 / 1024, "MB");
-        printBar(" TT Usage:     ", tree.tt.hashfull());
-        printStat(" Half Changes: ", formatNum(halfChanges));
+        printBar(" TT Usage:     ", snapshot.ttUsage);
+        printStat(" Half Changes: ", formatNum(snapshot.halfChanges));
         cout << "\n";
 
-        printStat(" Nodes:            ", suffixNum(nodeCount.load()));
+        printStat(" Nodes:            ", suffixNum(snapshot.nodes));
         printStat(" Time:             ", formatTime(elapsedMs));
-        printStat(" Nodes per second: ", suffixNum(nodeCount.load() * 1000 / elapsedMs));
+        printStat(" Nodes per second: ", suffixNum(snapshot.nodes * 1000 / elapsedMs));
         cout << "\n";
 
         cursor::clear();
-        cout << Colors::GREY << " Depth:     " << Colors::WHITE << cumulativeDepth / iterations << "\n";
-        cout << Colors::GREY << " Max depth: " << Colors::WHITE << seldepth << "\n\n";
+        cout << Colors::GREY << " Depth:     " << Colors::WHITE << snapshot.depth << "\n";
+        cout << Colors::GREY << " Max depth: " << Colors::WHITE << snapshot.seldepth << "\n\n";
 
         cursor::clear();
-        const float rootWdl = getAdjustedScore(root);
         cout << Colors::GREY << " Score:   ";
-        if (root.state.load().state() == ONGOING || root.state.load().state() == DRAW)
-            printColoredScore(rootWdl);
+        if (rootState.state() == ONGOING || rootState.state() == DRAW)
+            printColoredScore(snapshot.rootScore);
         else
-            cout << Colors::WHITE << "M in " << (root.state.load().distance() + 1) / 2 * (root.state.load().state() == WIN ? 1 : -1);
+            cout << Colors::WHITE << "M in " << (rootState.distance() + 1) / 2 * (rootState.state() == WIN ? 1 : -1);
         cout << "\n";
         if (multiPV > 1) {
-            for (usize i = 1; i <= multiPV; i++) {
+            for (usize i = 1; i <= std::min(multiPV, snapshot.lines.size()); i++) {
                 cursor::clear();
-                const Node&    n  = children[i - 1];
-                const MoveList pv = findPV(tree, &n);
                 cout << Colors::GREY << fmt::format(" PV {}: ", i);
-                printPV(pv);
+                printPV(snapshot.lines[i - 1].pv);
                 cout << "\n";
             }
         }
@@ -476,8 +980,99 @@ Move Searcher::search(const SearchParameters params, const SearchLimits limits)
         cout.flush();
     };
 
+    // UCI info is printed when the depth, seldepth or best move change and at least
+    // once a second. The pretty printer redraws every 40ms
+    // The search only publishes counters each iteration, the reporter polls them and
+    // asks for a full snapshot, PV lines included, only when it is going to print
+    SnapshotExchange<Snapshot> exchange;
+    atomic<u64>                publishedDepth    = 0;
+    atomic<u64>                publishedSeldepth = 0;
+    atomic<bool>               reporterStop      = false;
+    std::thread                reporter;
+    // Keeps the search's own info strings from splitting the reporter's lines
+    std::mutex                 outputMutex;
+
+    const auto runReporter = [&]() {
+        u64  lastDepth    = 0;
+        u64  lastSeldepth = 0;
+        Move lastMove     = Move::null();
+
+        Stopwatch<std::chrono::milliseconds> stopwatch;
+
+        while (!reporterStop.load(std::memory_order_relaxed)) {
+            if (params.doUci) {
+                const u64  depth    = publishedDepth.load(std::memory_order_relaxed);
+                const u64  seldepth = publishedSeldepth.load(std::memory_order_relaxed);
+                const Move bestMove = currentMove.load();
+
+                if (depth != lastDepth || seldepth != lastSeldepth || bestMove != lastMove || stopwatch.elapsed() >= UCI_REPORTING_FREQUENCY) {
+                    const Snapshot* snapshot = exchange.take(reporterStop);
+                    if (snapshot == nullptr)
+                        break;
+
+                    {
+                        std::lock_guard lock(outputMutex);
+                        printUCI(*snapshot);
+                    }
+                    lastDepth    = depth;
+                    lastSeldepth = seldepth;
+                    lastMove     = bestMove;
+                    stopwatch.reset();
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+            else {
+                const Snapshot* snapshot = exchange.take(reporterStop);
+                if (snapshot == nullptr)
+                    break;
+
+                const Move bestMove = snapshot->pv.length > 0 ? snapshot->pv[0] : Move::null();
+                if (bestMove != lastMove)
+                    bestMoves.push({ snapshot->elapsed, bestMove });
+                lastMove = bestMove;
+                prettyPrint(*snapshot);
+                std::this_thread::sleep_for(std::chrono::milliseconds(40));
+            }
+        }
+    };
+
     // Expand root
-    expandNode(tree, *searcherData, rootPos, tree.root(), currentIndex);
+    if (tree.root().numChildren == 0)
+        (inDatagen ? expandNode<DatagenConfig, Concurrency> : expandNode<PlayConfig, Concurrency>)(tree, *searcherData, rootPos, tree.root(), currentIndex, nullptr);
+
+    // Root moves into the tablebases are proven up front, and the best proven move
+    // proves the root when it decides it, so the shortest mate is the one played
+    if (tree.tablebases.isOpen() && !tree.root().isTerminal()) {
+        Node&       root       = tree.root();
+        Node*       child      = &tree[root.firstChild.load()];
+        vector<u64> posHistory = params.posHistory;
+        usize       best       = root.numChildren;
+        for (usize idx = 0; idx < root.numChildren; idx++) {
+            if (child[idx].visits == 0 && !child[idx].isTerminal()) {
+                Board board = rootPos;
+                board.move(child[idx].move.load());
+                posHistory.push_back(board.zobrist);
+                const GameState state = stateOf(board, posHistory, &tree.tablebases);
+                posHistory.pop_back();
+
+                if (state.state() != ONGOING)
+                    child[idx].state.store(state);
+            }
+
+            if (child[idx].isTerminal() && (best == root.numChildren || getAdjustedScore(child[idx]) < getAdjustedScore(child[best])))
+                best = idx;
+        }
+
+        tree.syncLanes(root);
+
+        if (best < root.numChildren) {
+            proveNode(tree, root, child[best]);
+            if (root.isTerminal())
+                root.pvChild = best;
+        }
+    }
+
+    rebuildRootTop(tree, multiPV);
 
     // Prepare for pretty printing
     if (params.doReporting && !params.doUci) {
@@ -486,12 +1081,22 @@ Move Searcher::search(const SearchParameters params, const SearchLimits limits)
         cursor::home();
     }
 
+    if (params.doReporting && !ponderParent && !(params.doUci && params.minimalUci))
+        reporter = std::thread(runReporter);
+
+    // The search parameters are picked once rather than on every node
+    const auto searchRoot = inDatagen ? searchNode<DatagenConfig, Concurrency> : searchNode<PlayConfig, Concurrency>;
+
+    // Carried down every descent, so an evaluation only changes the rows
+    // that differ from the last position its side to move saw
+    ValueCache valueCache;
+
     // Main search loop
     do {
         // Reset zobrist history
         vector<u64> posHistory = params.posHistory;
 
-        searchNode(tree, tree.root(), *searcherData, rootPos, currentIndex, seldepth, cumulativeDepth, posHistory, params, 0);
+        searchRoot(tree, tree.root(), *searcherData, valueCache, rootPos, currentIndex, seldepth, cumulativeDepth, posHistory, params, 0);
 
         // Switch halves
         if (tree.switchHalves) {
@@ -506,44 +1111,82 @@ Move Searcher::search(const SearchParameters params, const SearchLimits limits)
 
         iterations++;
 
-        // Check if UCI should be printed
-        if (params.doReporting) {
-            const Move bestMove = findPvMove(tree, tree.root());
-            if (params.doUci && !params.minimalUci
-                && (lastDepth != cumulativeDepth / iterations || lastSeldepth != seldepth || bestMove != lastMove || stopwatch.elapsed() >= UCI_REPORTING_FREQUENCY)) {
-                const Move bestMove = findPvMove(tree, tree.root());
-                printUCI();
-
-                lastDepth    = cumulativeDepth / iterations;
-                lastSeldepth = seldepth;
-                lastMove     = bestMove;
-                stopwatch.reset();
+        if (iterations % TIME_MANAGER_INTERVAL == 0 && tree.root().numChildren > 0) {
+            const RootStats stats = rootStats();
+
+            if (timeManager.enabled() && timeManager.update(stats) && logTime) {
+                std::lock_guard lock(outputMutex);
+                cout << "info string time " << TimeManager::decisionName(timeManager.decision) << " soft " << timeManager.soft() << " at " << limits.commandTime.elapsed() << endl;
             }
-            else if (!params.doUci && (iterations == 2 || stopwatch.elapsed() >= 40)) {
-                const Move bestMove = findPvMove(tree, tree.root());
-                if (bestMove != lastMove)
-                    bestMoves.push({ limits.commandTime.elapsed(), bestMove });
-                prettyPrint();
 
-                lastDepth    = cumulativeDepth / iterations;
-                lastSeldepth = seldepth;
-                lastMove     = bestMove;
-                stopwatch.reset();
+            if (!inDatagen && !pondering.load() && bestMoveSettled(stats)) {
+                earlyStop = true;
+                if (params.doReporting && params.doUci) {
+                    std::lock_guard lock(outputMutex);
+                    cout << "info string early stop at " << limits.commandTime.elapsed() << " best move settled" << endl;
+                }
             }
         }
-        if (iterations % 1024)
-            currentMove = findPvMove(tree, tree.root());
+
+        if (inDatagen && datagen::KLD_GAIN_STOP && iterations % datagen::KLD_GAIN_INTERVAL == 0 && tree.root().numChildren > 0)
+            earlyStop = kldConverged(rootStats());
+
+        currentMove = findPvMove(tree, tree.root());
+        publishedDepth.store(cumulativeDepth / iterations, std::memory_order_relaxed);
+        publishedSeldepth.store(seldepth, std::memory_order_relaxed);
+
+        exchange.serve(fillSnapshot);
     } while (!stopSearching());
 
-    const Move bestMove = findPvMove(tree, tree.root());
+    reporterStop = true;
+    if (reporter.joinable())
+        reporter.join();
+
+    // The line from the position the move is for, for a ponder search
+    // rooted before the expected reply that is the line after the reply
+    MoveList line = findPV(tree);
+    if (ponderParent) {
+        const Node  root  = tree.root();
+        const Node* child = &tree[root.firstChild];
+        line              = MoveList();
+        for (usize idx = 0; idx < root.numChildren; idx++) {
+            if (child[idx].move.load() != ponderMove || child[idx].numChildren == 0)
+                continue;
+            const MoveList pv = findPV(tree, child + idx);
+            for (usize i = 1; i < pv.length; i++)
+                line.add(pv[i]);
+        }
+
+        if (line.length == 0) {
+            Board afterReply = rootPos;
+            afterReply.move(ponderMove);
+            const MoveList moves = Movegen::generateMoves(afterReply);
+            line.add(moves.length > 0 ? moves[0] : Move::null());
+        }
+    }
+
+    const Move bestMove  = ponderParent ? line[0] : findPvMove(tree, tree.root());
+    const bool ponderhit = ponderSearch && !pondering.load();
+    pondering            = false;
+
+    if (logTime && outOfTime)
+        cout << "info string time stop at " << limits.commandTime.elapsed() << " soft " << timeManager.soft() << " hard " << timeManager.hard() << endl;
+
+    // After a ponderhit the search carries on as a normal search of the reply
+    if (params.doReporting && !ponderhit) {
+        Snapshot snapshot;
+        fillSnapshot(snapshot);
 
-    if (params.doReporting) {
         if (params.doUci) {
-            printUCI();
-            cout << "bestmove " << bestMove << endl;
+            if (!ponderParent)
+                printUCI(snapshot);
+            cout << "bestmove " << bestMove;
+            if (line.length > 1)
+                cout << " ponder " << line[1];
+            cout << endl;
         }
         else {
-            prettyPrint();
+            prettyPrint(snapshot);
             cout << "\n\nBest move: " << Colors::BRIGHT_BLUE << bestMove << Colors::RESET << endl;
             cursor::show();
         }
@@ -553,13 +1196,18 @@ Move Searcher::search(const SearchParameters params, const SearchLimits limits)
 
     currentMove = findPvMove(tree, tree.root());
 
+    // Done after the move is sent, so it costs no time on the clock
+    if (tree.experience.isOpen() && !inDatagen)
+        storeExperience(tree, tree.root(), rootPos);
+
     return bestMove;
 }
 
 // These two functions provide the capability to instantly move
 // based on the move prediction from either of the two NNs
 
-Move Searcher::searchPolicy(const SearchParameters params) {
+template<typename Concurrency>
+Move BasicSearcher<Concurrency>::searchPolicy(const SearchParameters params) {
     tree.activeTree()[0]   = Node();
     tree.inactiveTree()[0] = Node();
 
@@ -583,7 +1231,8 @@ Move Searcher::searchPolicy(const SearchParameters params) {
     return bestNode->move;
 }
 
-Move Searcher::searchValue(const SearchParameters params) {
+template<typename Concurrency>
+Move BasicSearcher<Concurrency>::searchValue(const SearchParameters params) {
     struct MoveEvalPair {
         Move move;
         i32  eval;
@@ -598,13 +1247,18 @@ Move Searcher::searchValue(const SearchParameters params) {
 
     const MoveList legalMoves = Movegen::generateMoves(rootPos);
 
+    vector<Board> children;
     for (const Move m : legalMoves) {
-        Board b = rootPos;
-        b.move(m);
-        const i32 score = evaluate(b);
-        moves.emplace_back(m, score);
+        children.push_back(rootPos);
+        children.back().move(m);
     }
 
+    vector<i32> evals(children.size());
+    evaluateBatch(children, evals);
+
+    for (usize idx = 0; idx < legalMoves.length; idx++)
+        moves.emplace_back(legalMoves[idx], evals[idx]);
+
     const Move best = std::ranges::max_element(moves, {}, [](const MoveEvalPair& m) { return m.eval; })->move;
 
     if (params.doReporting)
@@ -612,3 +1266,44 @@ Move Searcher::searchValue(const SearchParameters params) {
 
     return best;
 }
+
+template<typename Concurrency>
+void BasicSearcher<Concurrency>::tablebaseBench() {
+    struct RootTest {
+        const char*  fen;
+        RawGameState state;
+    };
+
+    // Every root move is proven by the tables before the search starts
+    static constexpr array tests = { RootTest{ "8/8/8/4k3/8/8/8/KQ6 w - - 0 1", WIN },
+                                     RootTest{ "8/8/8/4k3/8/8/8/KR6 w - - 0 1", WIN },
+                                     RootTest{ "8/8/8/4k3/8/8/8/KQ6 b - - 0 1", LOSS },
+                                     RootTest{ "8/8/8/4k3/8/8/8/KN6 w - - 0 1", DRAW } };
+
+    constexpr u64 NODE_LIMIT = 2000;
+
+    vector<u64>            posHistory;
+    const SearchParameters params(posHistory, true, true, false);
+
+    usize proven = 0;
+    for (const RootTest& test : tests) {
+        reset();
+        rootPos.loadFromFEN(test.fen);
+        posHistory = { rootPos.zobrist };
+
+        Stopwatch<std::chrono::milliseconds> stopwatch;
+        const SearchLimits                   limits(stopwatch, 0, 0, NODE_LIMIT, 0, 0, 0);
+        search(params, limits);
+
+        const bool ok = tree.root().state.load().state() == test.state;
+        proven += ok;
+        cout << fmt::format("{:<40} {:<4} {}", test.fen, GAME_STATE_STR[test.state], ok ? "ok" : "FAIL") << endl;
+    }
+
+    cout << fmt::format("{}/{} tablebase roots proven", proven, tests.size()) << endl;
+}
+
+template struct BasicSearcher<SingleThreaded>;
+
+template void expandNodeRaw(BasicTree<SingleThreaded>&, const Board&, BasicNode<SingleThreaded>&, u64&);
+template void expandNodeRaw(BasicTree<MultiThreaded>&, const Board&, BasicNode<MultiThreaded>&, u64&);
\ No newline at end of file
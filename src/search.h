@@ -34,14 +34,16 @@ struct SearchParameters {
 
 struct SearchLimits {
     Stopwatch<std::chrono::milliseconds> commandTime;
-    bool                                 mate;
+    // Length of the mate to search for in moves, 0 if none
+    usize                                mate;
     u64                                  nodes;
     i64                                  mtime;
     i64                                  time;
     i64                                  inc;
+    usize                                movesToGo;
     usize                                depth;
 
-    SearchLimits(const Stopwatch<std::chrono::milliseconds>& commandTime, const bool mate, const usize depth, const u64 nodes, const i64 mtime, const i64 time, const i64 inc) {
+    SearchLimits(const Stopwatch<std::chrono::milliseconds>& commandTime, const usize mate, const usize depth, const u64 nodes, const i64 mtime, const i64 time, const i64 inc, const usize movesToGo = 0) {
         this->commandTime = commandTime;
         this->mate        = mate;
         this->depth       = depth;
@@ -49,5 +51,6 @@ struct SearchLimits {
         this->mtime       = mtime;
         this->time        = time;
         this->inc         = inc;
+        this->movesToGo   = movesToGo;
     }
 };
\ No newline at end of file
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "datagen.h"
+#include "tunable.h"
+
+// Search parameters bundled per kind of search, passed to the search as a
+// template parameter so selection and expansion never branch on inDatagen
+// Tunables are only read at runtime in TUNE builds, otherwise every
+// parameter is dequantized at compile time
+#ifdef TUNE
+    #define CONFIG_PARAM static float
+#else
+    #define CONFIG_PARAM static constexpr float
+#endif
+
+struct PlayConfig {
+    CONFIG_PARAM cpuct() { return CPUCT / 10'000.0f; }
+    CONFIG_PARAM rootCpuct() { return ROOT_CPUCT / 10'000.0f; }
+    CONFIG_PARAM cpuctVisitScale() { return CPUCT_VISIT_SCALE; }
+    CONFIG_PARAM fpuMargin() { return FPU_SHARPNESS_MARGIN / 10'000.0f; }
+
+    CONFIG_PARAM giniBase() { return GINI_BASE / 10'000.0f; }
+    CONFIG_PARAM giniScalar() { return GINI_SCALAR / 10'000.0f; }
+    CONFIG_PARAM giniMin() { return GINI_MIN / 10'000.0f; }
+    CONFIG_PARAM giniMax() { return GINI_MAX / 10'000.0f; }
+
+    CONFIG_PARAM policyTemperature() { return POLICY_TEMPERATURE / 10'000.0f; }
+    CONFIG_PARAM egPolicyTemperature() { return EG_POLICY_TEMPERATURE / 10'000.0f; }
+    CONFIG_PARAM rootPolicyTemperature() { return ROOT_POLICY_TEMPERATURE / 10'000.0f; }
+    CONFIG_PARAM egRootPolicyTemperature() { return EG_ROOT_POLICY_TEMPERATURE / 10'000.0f; }
+
+    CONFIG_PARAM wideningBase() { return WIDENING_BASE; }
+    CONFIG_PARAM wideningScale() { return WIDENING_SCALE / 10'000.0f; }
+};
+
+// Datagen uses its own constants for exploration and temperature
+struct DatagenConfig : PlayConfig {
+    static constexpr float cpuct() { return datagen::CPUCT; }
+    static constexpr float rootCpuct() { return datagen::ROOT_CPUCT; }
+
+    static constexpr float policyTemperature() { return datagen::POLICY_TEMPERATURE; }
+    static constexpr float egPolicyTemperature() { return datagen::EG_POLICY_TEMPERATURE; }
+    static constexpr float rootPolicyTemperature() { return datagen::ROOT_POLICY_TEMPERATURE; }
+    static constexpr float egRootPolicyTemperature() { return datagen::EG_ROOT_POLICY_TEMPERATURE; }
+};
+
+#undef CONFIG_PARAM
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include "types.h"
 
 #include <cstring>
+#include <algorithm>
 
 // Based on Vine
 namespace simd {
@@ -70,6 +71,38 @@ inline T reduce_ep(const Vector<T> v) {
     return res;
 }
 
+template<typename T>
+inline T reduce_max_ep(const Vector<T> v) {
+    T vals[VECTOR_SIZE<T>];
+    std::memcpy(vals, &v, sizeof(vals));
+    T res = vals[0];
+    for (T val : vals)
+        res = std::max(res, val);
+    return res;
+}
+
+template<typename T>
+inline Vector<T> set1_ep(const T value) {
+    return Vector<T>{} + value;
+}
+
+// Lanes of a where the mask from a vector comparison is set, and of b elsewhere
+template<typename T, typename Mask>
+inline Vector<T> select_ep(const Mask mask, const Vector<T> a, const Vector<T> b) {
+    return (Vector<T>)(((Mask)a & mask) | ((Mask)b & ~mask));
+}
+
+template<typename Mask>
+inline bool any_ep(const Mask mask) {
+    static_assert(sizeof(Mask) == VECTOR_BYTES);
+    u64 words[VECTOR_BYTES / sizeof(u64)];
+    std::memcpy(words, &mask, sizeof(words));
+    u64 res = 0;
+    for (u64 word : words)
+        res |= word;
+    return res != 0;
+}
+
 #ifdef __x86_64__
     #include <immintrin.h>
 inline Vector<i32> madd_epi16(const Vector<i16> a, const Vector<i16> b) {
@@ -81,6 +114,19 @@ inline Vector<i32> madd_epi16(const Vector<i16> a, const Vector<i16> b) {
     return _mm_madd_epi16(a, b);
     #endif
 }
+
+// Approximate 1 / v, with a Newton-Raphson step taking
+// the estimate to about 22 bits of precision
+inline Vector<float> rcp_ps(const Vector<float> v) {
+    #if defined(__AVX512F__)
+    const Vector<float> r = _mm512_rcp14_ps(v);
+    #elif defined(__AVX2__)
+    const Vector<float> r = _mm256_rcp_ps(v);
+    #elif defined(__SSE__)
+    const Vector<float> r = _mm_rcp_ps(v);
+    #endif
+    return r * (2.0f - v * r);
+}
 #elif defined(__arm__) || defined(__aarch64__)
     #if defined(__ARM_NEON)
         #include <arm_neon.h>
@@ -92,6 +138,13 @@ inline Vector<i32> madd_epi16(const Vector<i16> a, const Vector<i16> b) {
     return vaddq_s32(mul_low, mul_high);
 }
 
+// Approximate 1 / v, the estimate is only good to 8 bits so it takes two Newton-Raphson steps
+inline Vector<float> rcp_ps(const Vector<float> v) {
+    float32x4_t r = vrecpeq_f32(v);
+    r             = vmulq_f32(r, vrecpsq_f32(v, r));
+    return vmulq_f32(r, vrecpsq_f32(v, r));
+}
+
     #endif
 #endif
 }
\ No newline at end of file
@@ -0,0 +1,620 @@
+#include "tablebase.h"
+
+#include "stopwatch.h"
+#include "threadpool.h"
+
+#include <bit>
+#include <atomic>
+#include <random>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+
+using namespace tablebase;
+
+namespace {
+constexpr array<char, 8> TABLE_MAGIC   = { 'C', 'H', 'A', 'O', 'S', 'T', 'B', 'L' };
+constexpr u32            TABLE_VERSION = 1;
+
+struct TableHeader {
+    array<char, 8> magic;
+    u32            version;
+    u32            pieces;
+    u64            size;
+};
+
+static_assert(sizeof(TableHeader) == 24);
+
+// Values only seen while a table is being generated
+constexpr u8 UNKNOWN   = 0;
+constexpr u8 STALEMATE = 254;
+constexpr u8 ILLEGAL   = 255;
+
+// Indices are split into chunks that are generated as one task
+constexpr u64 CHUNK_SIZE = 1 << 16;
+
+// Squares the white king is moved to, without and with pawns
+constexpr array<Square, 10> TRIANGLE = { a1, b1, c1, d1, b2, c2, d2, c3, d3, d4 };
+
+constexpr array<i8, 64> TRIANGLE_SLOT = [] {
+    array<i8, 64> slots{};
+    slots.fill(-1);
+    for (usize i = 0; i < TRIANGLE.size(); i++)
+        slots[TRIANGLE[i]] = i;
+    return slots;
+}();
+
+constexpr char PIECE_CHARS[] = "PNBRQ";
+
+// Material as 3 bits per piece type, white in the low bits
+u32 materialKey(const vector<PieceType>& white, const vector<PieceType>& black) {
+    u32 key = 0;
+    for (const PieceType pt : white)
+        key += 1 << (3 * pt);
+    for (const PieceType pt : black)
+        key += 1 << (15 + 3 * pt);
+    return key;
+}
+
+u32 materialKey(const Board& board, const bool flip) {
+    u32 key = 0;
+    for (PieceType pt = PAWN; pt < KING; pt = PieceType(pt + 1)) {
+        key += std::popcount(board.pieces(flip ? BLACK : WHITE, pt)) << (3 * pt);
+        key += std::popcount(board.pieces(flip ? WHITE : BLACK, pt)) << (15 + 3 * pt);
+    }
+    return key;
+}
+
+// Moves the white king into its slots, the transformation is a set of
+// a file mirror (1), rank mirror (2) and a flip along the a1-h8 diagonal (4)
+u8 symmetryFor(Square whiteKing, const bool pawns) {
+    u8 symmetry = 0;
+    if (whiteKing % 8 > 3) {
+        symmetry |= 1;
+        whiteKing = Square(whiteKing ^ 7);
+    }
+    if (pawns)
+        return symmetry;
+
+    if (whiteKing / 8 > 3) {
+        symmetry |= 2;
+        whiteKing = Square(whiteKing ^ 56);
+    }
+    if (whiteKing / 8 > whiteKing % 8)
+        symmetry |= 4;
+    return symmetry;
+}
+
+u8 transform(u8 sq, const u8 symmetry) {
+    if (symmetry & 1)
+        sq ^= 7;
+    if (symmetry & 2)
+        sq ^= 56;
+    if (symmetry & 4)
+        sq = (sq % 8) * 8 + sq / 8;
+    return sq;
+}
+
+// Calls visit with every position that reaches this one by a move that keeps the
+// material, which are in the same table. Some of them are illegal
+template<typename Visit>
+void forEachUnmove(const Board& board, const Visit& visit) {
+    const Color   mover    = ~board.stm;
+    const u64     occupied = board.pieces();
+    array<u64, 6> pieceBBs = board.byPieces;
+    array<u64, 2> colorBBs = board.byColor;
+
+    for (PieceType pt = PAWN; pt <= KING; pt = PieceType(pt + 1)) {
+        u64 pieces = board.pieces(mover, pt);
+        while (pieces) {
+            const Square to = popLSB(pieces);
+
+            u64 from = 0;
+            if (pt == PAWN) {
+                const int back   = mover == WHITE ? -8 : 8;
+                const int single = to + back;
+                if (single >= 8 && single < 56 && !(occupied & (1ULL << single))) {
+                    from |= 1ULL << single;
+                    if ((single + back) / 8 == (mover == WHITE ? 1 : 6))
+                        from |= 1ULL << (single + back);
+                }
+            }
+            else if (pt == KNIGHT)
+                from = Movegen::KNIGHT_ATTACKS[to];
+            else if (pt == BISHOP)
+                from = Movegen::getBishopAttacks(to, occupied);
+            else if (pt == ROOK)
+                from = Movegen::getRookAttacks(to, occupied);
+            else if (pt == QUEEN)
+                from = Movegen::getBishopAttacks(to, occupied) | Movegen::getRookAttacks(to, occupied);
+            else
+                from = Movegen::KING_ATTACKS[to];
+            from &= ~occupied;
+
+            while (from) {
+                const u64 change = (1ULL << to) | (1ULL << popLSB(from));
+                pieceBBs[pt] ^= change;
+                colorBBs[mover] ^= change;
+                visit(pieceBBs, colorBBs);
+                pieceBBs[pt] ^= change;
+                colorBBs[mover] ^= change;
+            }
+        }
+    }
+}
+
+// Every material configuration of up to MAX_PIECES pieces, with the
+// stronger side as white, ordered so that each table comes after
+// the tables its captures and promotions lead to
+vector<std::pair<vector<PieceType>, vector<PieceType>>> allMaterial() {
+    // Multisets of non king pieces, strongest first
+    vector<vector<PieceType>> sets = { {} };
+    for (usize size = 1; size <= MAX_PIECES - 2; size++) {
+        vector<vector<PieceType>> next;
+        for (const vector<PieceType>& set : sets) {
+            if (set.size() != size - 1)
+                continue;
+            for (PieceType pt = PAWN; pt < KING; pt = PieceType(pt + 1)) {
+                if (!set.empty() && pt > set.back())
+                    continue;
+                vector<PieceType> extended = set;
+                extended.push_back(pt);
+                next.push_back(extended);
+            }
+        }
+        sets.insert(sets.end(), next.begin(), next.end());
+    }
+
+    vector<std::pair<vector<PieceType>, vector<PieceType>>> material;
+    for (const vector<PieceType>& white : sets) {
+        for (const vector<PieceType>& black : sets) {
+            const usize pieces = 2 + white.size() + black.size();
+            if (pieces < 3 || pieces > MAX_PIECES)
+                continue;
+            if (white.size() < black.size() || (white.size() == black.size() && white < black))
+                continue;
+            material.emplace_back(white, black);
+        }
+    }
+
+    const auto pawnCount = [](const std::pair<vector<PieceType>, vector<PieceType>>& m) { return std::ranges::count(m.first, PAWN) + std::ranges::count(m.second, PAWN); };
+    std::ranges::stable_sort(material, [&](const auto& a, const auto& b) {
+        const usize aPieces = a.first.size() + a.second.size();
+        const usize bPieces = b.first.size() + b.second.size();
+        return aPieces != bPieces ? aPieces < bPieces : pawnCount(a) < pawnCount(b);
+    });
+    return material;
+}
+}
+
+Table::Table(const vector<PieceType>& white, const vector<PieceType>& black) {
+    this->white = white;
+    this->black = black;
+
+    name = "K";
+    for (const PieceType pt : white)
+        name += PIECE_CHARS[pt];
+    name += "vK";
+    for (const PieceType pt : black)
+        name += PIECE_CHARS[pt];
+
+    pawns = std::ranges::count(white, PAWN) + std::ranges::count(black, PAWN) > 0;
+    size  = (pawns ? 32 : TRIANGLE.size()) * 2;
+    for (usize i = 1; i < pieceCount(); i++)
+        size *= 64;
+
+    longest = 0;
+    values  = nullptr;
+}
+
+u64 Table::index(const Board& board, const bool flip) const { return index(board.byPieces, board.byColor, board.stm, flip); }
+
+u64 Table::index(const array<u64, 6>& pieceBBs, const array<u64, 2>& colorBBs, const Color stm, const bool flip, const bool mirrored) const {
+    const auto   pieces    = [&](const Color c, const PieceType pt) { return pieceBBs[pt] & colorBBs[c]; };
+    const Color  whiteSide = flip ? BLACK : WHITE;
+    const auto   square    = [&](const Square sq) { return flip ? Square(sq ^ 56) : sq; };
+    const Square whiteKing = square(Square(std::countr_zero(pieces(whiteSide, KING))));
+    u8           symmetry  = symmetryFor(whiteKing, pawns);
+
+    const u8 kingSq = transform(whiteKing, symmetry);
+    u64      idx    = pawns ? (kingSq / 8) * 4 + kingSq % 8 : TRIANGLE_SLOT[kingSq];
+
+    if (mirrored && !pawns && kingSq / 8 == kingSq % 8)
+        symmetry ^= 4;
+    idx = idx * 64 + transform(square(Square(std::countr_zero(pieces(~whiteSide, KING)))), symmetry);
+
+    // Pieces of the same type are taken in the order of their squares after
+    // the transformation, so every orientation of a position shares its index
+    const auto addPieces = [&](const Color c, const vector<PieceType>& types) {
+        for (usize i = 0; i < types.size();) {
+            array<u8, MAX_PIECES> squares;
+            usize                 count     = 0;
+            u64                   remaining = pieces(c, types[i]);
+            while (remaining)
+                squares[count++] = transform(square(popLSB(remaining)), symmetry);
+            std::sort(squares.begin(), squares.begin() + count);
+
+            for (usize j = 0; j < count; j++)
+                idx = idx * 64 + squares[j];
+            i += count;
+        }
+    };
+    addPieces(whiteSide, white);
+    addPieces(~whiteSide, black);
+
+    return idx * 2 + (flip ? stm == BLACK : stm == WHITE);
+}
+
+bool Table::decode(u64 idx, Board& board) const {
+    const Color stm = idx % 2 ? WHITE : BLACK;
+    idx /= 2;
+
+    array<u64, 6> pieceBBs{};
+    array<u64, 2> colorBBs{};
+
+    const auto place = [&](const Color c, const PieceType pt, const u8 sq) {
+        const u64 bb = 1ULL << sq;
+        if ((colorBBs[WHITE] | colorBBs[BLACK]) & bb)
+            return false;
+        if (pt == PAWN && (sq < 8 || sq >= 56))
+            return false;
+        pieceBBs[pt] |= bb;
+        colorBBs[c] |= bb;
+        return true;
+    };
+
+    for (usize i = black.size(); i-- > 0;) {
+        if (!place(BLACK, black[i], idx % 64))
+            return false;
+        idx /= 64;
+    }
+    for (usize i = white.size(); i-- > 0;) {
+        if (!place(WHITE, white[i], idx % 64))
+            return false;
+        idx /= 64;
+    }
+    if (!place(BLACK, KING, idx % 64))
+        return false;
+    idx /= 64;
+    if (!place(WHITE, KING, pawns ? static_cast<u8>((idx / 4) * 8 + idx % 4) : static_cast<u8>(TRIANGLE[idx])))
+        return false;
+
+    board.loadFromBitboards(pieceBBs, colorBBs, stm);
+    return !board.inCheck(~stm);
+}
+
+Table& Tablebases::add(std::unique_ptr<Table> table) {
+    maxPieces = std::max(maxPieces, table->pieceCount());
+    byMaterial[materialKey(table->white, table->black)] = table.get();
+    tables.push_back(std::move(table));
+    return *tables.back();
+}
+
+usize Tablebases::load(const string& directory) {
+    close();
+
+    for (const auto& [white, black] : allMaterial()) {
+        auto table = std::make_unique<Table>(white, black);
+        if (!table->file.open(directory + "/" + table->name + ".ctb") || table->file.size() < sizeof(TableHeader))
+            continue;
+
+        TableHeader header;
+        std::memcpy(&header, table->file.data(), sizeof(header));
+        if (header.magic != TABLE_MAGIC || header.version != TABLE_VERSION || header.size != table->size || table->file.size() != sizeof(header) + table->size)
+            continue;
+
+        table->values = reinterpret_cast<const u8*>(table->file.data() + sizeof(header));
+        add(std::move(table));
+    }
+    return tables.size();
+}
+
+void Tablebases::close() {
+    tables.clear();
+    byMaterial.clear();
+    maxPieces = 0;
+}
+
+const Table* Tablebases::find(const Board& board, bool& flip) const {
+    if (static_cast<usize>(std::popcount(board.pieces())) > maxPieces || board.canCastle(WHITE) || board.canCastle(BLACK))
+        return nullptr;
+
+    for (const bool swapped : { false, true }) {
+        const auto it = byMaterial.find(materialKey(board, swapped));
+        if (it != byMaterial.end()) {
+            flip = swapped;
+            return it->second;
+        }
+    }
+    return nullptr;
+}
+
+bool Tablebases::valueFromMoves(const Board& board, const MoveList& moves, u8& result) const {
+    if (moves.length == 0) {
+        result = board.inCheck() ? 1 : 0;
+        return true;
+    }
+
+    // Values of the children are from the opponent's side, a child
+    // the opponent loses is a win one ply further away
+    u8   shortestWin = 0;
+    u8   longestLoss = 0;
+    bool allLost     = true;
+    for (const Move m : moves) {
+        Board child = board;
+        child.move(m);
+
+        u8 childValue;
+        if (!value(child, childValue))
+            return false;
+
+        if (childValue == 0)
+            allLost = false;
+        else if ((childValue - 1) % 2 == 0)
+            shortestWin = shortestWin == 0 ? childValue + 1 : std::min<u8>(shortestWin, childValue + 1);
+        else
+            longestLoss = std::max<u8>(longestLoss, childValue + 1);
+    }
+
+    result = shortestWin ? shortestWin : allLost ? longestLoss : 0;
+    return true;
+}
+
+bool Tablebases::value(const Board& board, u8& result) const {
+    if (board.epSquare != NO_SQUARE) {
+        const MoveList moves = Movegen::generateMoves(board);
+        if (std::ranges::any_of(moves, [](const Move m) { return m.typeOf() == EN_PASSANT; }))
+            return valueFromMoves(board, moves, result);
+    }
+
+    bool         flip;
+    const Table* table = find(board, flip);
+    if (table == nullptr) {
+        // Bare kings are the only position without a table
+        result = 0;
+        return std::popcount(board.pieces()) == 2;
+    }
+
+    result = table->values[table->index(board, flip)];
+    // Only seen in a table still being generated
+    if (result == STALEMATE || result == ILLEGAL)
+        result = 0;
+    return true;
+}
+
+GameState Tablebases::probe(const Board& board) const {
+    u8 result;
+    if (!isOpen() || !value(board, result))
+        return GameState(ONGOING);
+    if (result == 0)
+        return GameState(DRAW);
+
+    // The tables are DTM only, a mate the fifty-move rule may reach
+    // first is left to the search
+    const u8 plies = result - 1;
+    if (board.halfMoveClock + plies > 100)
+        return GameState(ONGOING);
+    return GameState(plies % 2 ? WIN : LOSS, plies);
+}
+
+// Every position is given a value in the order of its distance to mate. Mates
+// are found first, then each pass resolves the positions one ply further away:
+// wins with a move to a loss found in the last pass, and losses whose moves
+// all lead to wins, the longest of which was found in the last pass. A pass only
+// looks at the positions that can reach the last pass's results, and at those
+// waiting on a mate in an earlier table. Positions still unresolved once
+// nothing is left to look at are draws
+Table& Tablebases::generateTable(std::unique_ptr<Table> newTable, const usize threads) {
+    Table& table = add(std::move(newTable));
+    table.generated.assign(table.size, UNKNOWN);
+    table.values = table.generated.data();
+
+    ThreadPool  pool(threads);
+    const usize chunks = (table.size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    u8*         values = table.generated.data();
+
+    const auto forEachChunk = [&](const auto& work) {
+        TaskGroup group(pool);
+        for (usize chunk = 0; chunk < chunks; chunk++)
+            group.run([&, chunk]() { work(chunk, chunk * CHUNK_SIZE, std::min(table.size, (chunk + 1) * CHUNK_SIZE)); });
+    };
+
+    forEachChunk([&](const usize, const u64 begin, const u64 end) {
+        Board board;
+        for (u64 idx = begin; idx < end; idx++) {
+            if (!table.decode(idx, board))
+                values[idx] = ILLEGAL;
+            else if (Movegen::generateMoves(board).length == 0)
+                values[idx] = board.inCheck() ? 1 : STALEMATE;
+        }
+    });
+
+    // The pass each position is next looked at in, the first looks at all of them
+    vector<u8> wake(table.size, 1);
+    u8         lastWake = 0;
+
+    // Results and wakes are applied between passes so a pass only reads the last one's values
+    vector<vector<std::pair<u64, u8>>> resolved(chunks);
+    vector<vector<std::pair<u64, u8>>> waiting(chunks);
+    vector<u8>                         chunkLastWake(chunks, 0);
+
+    for (u8 ply = 1; ply < STALEMATE - 1; ply++) {
+        forEachChunk([&](const usize chunk, const u64 begin, const u64 end) {
+            Board board;
+            for (u64 idx = begin; idx < end; idx++) {
+                if (values[idx] != UNKNOWN || wake[idx] != ply)
+                    continue;
+                table.decode(idx, board);
+
+                u8   shortestWin = 0;
+                u8   longestLoss = 0;
+                bool allLost     = true;
+                bool enPassant   = false;
+                for (const Move m : Movegen::generateMoves(board)) {
+                    Board child = board;
+                    child.move(m);
+
+                    // The value of a child with an en passant capture comes from its
+                    // own children, so it can change without this position being woken
+                    if (child.epSquare != NO_SQUARE && (Movegen::pawnAttackBB(~child.stm, child.epSquare) & child.pieces(child.stm, PAWN)))
+                        enPassant = true;
+
+                    u8 childValue;
+                    if (!value(child, childValue) || childValue == 0) {
+                        allLost = false;
+                        continue;
+                    }
+
+                    const u8 childPlies = childValue - 1;
+                    if (childPlies % 2 == 0) {
+                        shortestWin = shortestWin == 0 ? childPlies + 1 : std::min<u8>(shortestWin, childPlies + 1);
+                        allLost     = false;
+                    }
+                    else
+                        longestLoss = std::max<u8>(longestLoss, childPlies + 1);
+                }
+
+                if (shortestWin != 0 && shortestWin <= ply)
+                    resolved[chunk].emplace_back(idx, shortestWin + 1);
+                else if (allLost && longestLoss <= ply)
+                    resolved[chunk].emplace_back(idx, longestLoss + 1);
+                else {
+                    // Mates in earlier tables decide the position in a later pass
+                    const u8 decidedAt = shortestWin != 0 ? shortestWin : allLost ? longestLoss : 0;
+                    chunkLastWake[chunk] = std::max(chunkLastWake[chunk], decidedAt);
+                    if (enPassant || decidedAt != 0)
+                        waiting[chunk].emplace_back(idx, enPassant ? ply + 1 : decidedAt);
+                }
+            }
+        });
+
+        bool changed = false;
+        for (usize chunk = 0; chunk < chunks; chunk++) {
+            changed |= !resolved[chunk].empty();
+            for (const auto& [idx, result] : resolved[chunk]) {
+                values[idx]   = result;
+                table.longest = std::max<u8>(table.longest, result - 1);
+            }
+            for (const auto& [idx, pass] : waiting[chunk])
+                wake[idx] = pass;
+            waiting[chunk].clear();
+            lastWake = std::max(lastWake, chunkLastWake[chunk]);
+        }
+
+        // Positions that can move into a new result are looked at in the next pass
+        forEachChunk([&](const usize chunk, const u64, const u64) {
+            Board board;
+            for (const auto& [idx, result] : resolved[chunk]) {
+                table.decode(idx, board);
+                forEachUnmove(board, [&](const array<u64, 6>& pieceBBs, const array<u64, 2>& colorBBs) {
+                    for (const bool mirrored : { false, true })
+                        std::atomic_ref(wake[table.index(pieceBBs, colorBBs, ~board.stm, false, mirrored)]).store(ply + 1, std::memory_order_relaxed);
+                });
+            }
+        });
+
+        for (vector<std::pair<u64, u8>>& chunkResolved : resolved)
+            chunkResolved.clear();
+
+        if (!changed && ply >= lastWake)
+            break;
+    }
+
+    for (u64 idx = 0; idx < table.size; idx++)
+        if (values[idx] == STALEMATE || values[idx] == ILLEGAL)
+            values[idx] = 0;
+
+    return table;
+}
+
+bool Tablebases::generate(const string& directory, const usize threads) {
+    close();
+
+    Stopwatch<std::chrono::milliseconds> total;
+
+    for (const auto& [white, black] : allMaterial()) {
+        auto table = std::make_unique<Table>(white, black);
+
+        const string path = directory + "/" + table->name + ".ctb";
+        if (!directory.empty()) {
+            if (table->file.open(path) && table->file.size() == sizeof(TableHeader) + table->size) {
+                TableHeader header;
+                std::memcpy(&header, table->file.data(), sizeof(header));
+                if (header.magic == TABLE_MAGIC && header.version == TABLE_VERSION) {
+                    table->values = reinterpret_cast<const u8*>(table->file.data() + sizeof(header));
+                    for (u64 idx = 0; idx < table->size; idx++)
+                        table->longest = std::max<u8>(table->longest, table->values[idx] ? table->values[idx] - 1 : 0);
+                    cout << table->name << " already generated" << endl;
+                    add(std::move(table));
+                    continue;
+                }
+            }
+            table->file.close();
+        }
+
+        Stopwatch<std::chrono::milliseconds> stopwatch;
+
+        const Table& generated = generateTable(std::move(table), threads);
+
+        const u64 elapsed = std::max<u64>(stopwatch.elapsed(), 1);
+        cout << generated.name << ": " << generated.size << " positions in " << elapsed << " ms (" << generated.size * 1000 / elapsed << " positions/s), longest mate "
+             << static_cast<int>(generated.longest) << " plies" << endl;
+
+        if (directory.empty())
+            continue;
+
+        std::ofstream     file(path, std::ios::binary | std::ios::trunc);
+        const TableHeader header{ TABLE_MAGIC, TABLE_VERSION, static_cast<u32>(generated.pieceCount()), generated.size };
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(generated.values), generated.size);
+        if (!file) {
+            cout << "Failed writing " << path << endl;
+            return false;
+        }
+    }
+
+    cout << "Generated " << tables.size() << " tables in " << total.elapsed() << " ms" << endl;
+    return true;
+}
+
+void tablebase::bench(const usize threads, Tablebases& tablebases) {
+    tablebases.close();
+
+    // Only the 3 piece tables, the 4 piece ones take minutes
+    Stopwatch<std::chrono::milliseconds> stopwatch;
+    u64                                  positions = 0;
+    for (const auto& [white, black] : allMaterial()) {
+        if (2 + white.size() + black.size() > 3)
+            break;
+        positions += tablebases.generateTable(std::make_unique<Table>(white, black), threads).size;
+    }
+    const u64 genTime = std::max<u64>(stopwatch.elapsed(), 1);
+
+    // Probes of random legal positions from the generated tables
+    std::mt19937_64 engine(0);
+    vector<Board>   boards;
+    for (const auto& [white, black] : allMaterial()) {
+        if (2 + white.size() + black.size() > 3)
+            break;
+        const Table                        table(white, black);
+        std::uniform_int_distribution<u64> dist(0, table.size - 1);
+        Board                              board;
+        for (usize found = 0; found < 20'000;) {
+            if (table.decode(dist(engine), board)) {
+                boards.push_back(board);
+                found++;
+            }
+        }
+    }
+
+    stopwatch.reset();
+    u64 decided = 0;
+    for (usize rep = 0; rep < 10; rep++)
+        for (const Board& board : boards)
+            decided += tablebases.probe(board).state() != DRAW;
+    const u64 probeTime = std::max<u64>(stopwatch.elapsed(), 1);
+    const u64 probes    = boards.size() * 10;
+
+    cout << "Generated " << positions << " positions in " << genTime << " ms (" << positions * 1000 / genTime << " positions/s)" << endl;
+    cout << probes << " probes in " << probeTime << " ms (" << probes * 1000 / probeTime << " probes/s), " << decided / 10 << " of " << boards.size() << " decided" << endl;
+}
\ No newline at end of file
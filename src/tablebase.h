@@ -0,0 +1,92 @@
+#pragma once
+
+#include "board.h"
+#include "types.h"
+#include "movegen.h"
+#include "mappedfile.h"
+
+#include <memory>
+#include <unordered_map>
+
+// Endgame tables for every material configuration of up to MAX_PIECES
+// pieces, generated by retrograde analysis. Each position takes one byte,
+// 0 for a draw and otherwise one more than the distance to mate in plies,
+// which is odd when the side to move mates and even when it is mated
+// Tables are stored with the side with more material as white and the white
+// king moved into the a1-d1-d4 triangle by symmetry, or onto the queenside
+// files when there are pawns. The fifty move rule is not considered
+class Tablebases;
+
+namespace tablebase {
+constexpr usize MAX_PIECES = 4;
+
+struct Table {
+    string            name;
+    vector<PieceType> white;
+    vector<PieceType> black;
+    bool              pawns;
+    u64               size;
+    // The longest mate in the table in plies
+    u8 longest;
+
+    MappedFile file;
+    vector<u8> generated;
+    const u8*  values;
+
+    Table(const vector<PieceType>& white, const vector<PieceType>& black);
+
+    usize pieceCount() const { return 2 + white.size() + black.size(); }
+
+    // Index of a position with this material, with the colors
+    // swapped first if the position's stronger side is black
+    // Positions with the white king on the a1-h8 diagonal are stored twice,
+    // mirrored along it, and mirrored picks the second of those indices
+    u64 index(const Board& board, bool flip) const;
+    u64 index(const array<u64, 6>& pieceBBs, const array<u64, 2>& colorBBs, Color stm, bool flip, bool mirrored = false) const;
+    // Set up the position at an index, false if it can't occur
+    bool decode(u64 idx, Board& board) const;
+};
+
+// Measures generation and probe speed on the 3 piece tables,
+// which are generated into tablebases
+void bench(usize threads, Tablebases& tablebases);
+}
+
+class Tablebases {
+    vector<std::unique_ptr<tablebase::Table>>  tables;
+    std::unordered_map<u32, tablebase::Table*> byMaterial;
+    usize                                      maxPieces;
+
+    tablebase::Table& add(std::unique_ptr<tablebase::Table> table);
+    tablebase::Table& generateTable(std::unique_ptr<tablebase::Table> table, usize threads);
+
+    // The best value among the position's moves, used for positions with
+    // an en passant capture, which the tables don't store
+    bool valueFromMoves(const Board& board, const MoveList& moves, u8& result) const;
+
+   public:
+    Tablebases() { maxPieces = 0; }
+
+    bool  isOpen() const { return maxPieces > 0; }
+    usize largest() const { return maxPieces; }
+
+    // Load every table in the directory, returns the number loaded
+    usize load(const string& directory);
+    void  close();
+
+    // Generate every table into the directory, tables already
+    // there are loaded instead. An empty directory keeps them in memory
+    bool generate(const string& directory, usize threads);
+
+    // The table for the position's material and whether the colors are swapped in it
+    const tablebase::Table* find(const Board& board, bool& flip) const;
+
+    // The stored byte of a position, false if no table covers it
+    bool value(const Board& board, u8& result) const;
+
+    // The proven state of the position, ONGOING if no table covers it
+    // or the fifty-move rule may come before the mate
+    GameState probe(const Board& board) const;
+
+    friend void tablebase::bench(usize threads, Tablebases& tablebases);
+};
\ No newline at end of file
@@ -0,0 +1,200 @@
+#pragma once
+
+#include "types.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <deque>
+
+// A small work-stealing thread pool
+// Each worker owns a deque, it pushes and pops new tasks at the
+// back (depth first) while idle workers steal from the front,
+// where the oldest and usually largest tasks are
+// The thread that constructs the pool acts as worker 0 and
+// only runs tasks while it waits on a TaskGroup
+// Every task belongs to a scope, a thread waiting on a group only runs
+// tasks of the group's scope, so isolated tasks (each with a scope of
+// their own, queued in order on a separate queue) never run each
+// other's work while they wait. Scope 0 is unscoped and runs anything
+class ThreadPool {
+    struct Task {
+        std::function<void()> run;
+        u64                   scope;
+    };
+
+    struct Worker {
+        std::mutex       mutex;
+        std::deque<Task> tasks;
+    };
+
+    vector<std::unique_ptr<Worker>> workers;
+    vector<std::thread>             threads;
+    Worker                          isolated;
+
+    atomic<u64>             nextScope;
+    atomic<u64>             pendingTasks;
+    atomic<bool>            stopping;
+    std::mutex              sleepMutex;
+    std::condition_variable sleepCondition;
+
+    static inline thread_local ThreadPool* currentPool   = nullptr;
+    static inline thread_local usize       currentWorker = 0;
+    static inline thread_local u64         currentScope  = 0;
+
+    // Pop the newest (or when stealing, the oldest) task within the scope
+    bool popTask(Worker& worker, Task& task, const bool steal, const u64 scope) {
+        const auto inScope = [&](const Task& t) { return scope == 0 || t.scope == scope; };
+
+        std::lock_guard lk(worker.mutex);
+
+        auto it = worker.tasks.end();
+        if (steal)
+            it = std::find_if(worker.tasks.begin(), worker.tasks.end(), inScope);
+        else if (const auto rit = std::find_if(worker.tasks.rbegin(), worker.tasks.rend(), inScope); rit != worker.tasks.rend())
+            it = std::prev(rit.base());
+
+        if (it == worker.tasks.end())
+            return false;
+
+        task = std::move(*it);
+        worker.tasks.erase(it);
+        pendingTasks.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    void workerLoop(const usize workerIdx) {
+        currentPool   = this;
+        currentWorker = workerIdx;
+
+        while (!stopping.load(std::memory_order_relaxed)) {
+            if (runPending())
+                continue;
+
+            std::unique_lock lk(sleepMutex);
+            sleepCondition.wait(lk, [&]() { return stopping.load() || pendingTasks.load() > 0; });
+        }
+    }
+
+   public:
+    explicit ThreadPool(const usize threadCount) {
+        assert(threadCount > 0);
+
+        nextScope    = 1;
+        pendingTasks = 0;
+        stopping     = false;
+
+        for (usize i = 0; i < threadCount; i++)
+            workers.push_back(std::make_unique<Worker>());
+
+        currentPool   = this;
+        currentWorker = 0;
+
+        for (usize i = 1; i < threadCount; i++)
+            threads.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard lk(sleepMutex);
+            stopping = true;
+        }
+        sleepCondition.notify_all();
+
+        for (std::thread& t : threads)
+            if (t.joinable())
+                t.join();
+
+        currentPool = nullptr;
+    }
+
+    ThreadPool(const ThreadPool&)            = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    usize size() const { return workers.size(); }
+
+    // The scope tasks of the calling thread belong to
+    static u64 scope() { return currentScope; }
+
+    // A scope that no other task belongs to
+    u64 newScope() { return nextScope.fetch_add(1, std::memory_order_relaxed); }
+
+    // Queue a task on the calling worker's deque, or
+    // at the back of the isolated queue
+    void submit(std::function<void()> task, const u64 scope, const bool isIsolated = false) {
+        Worker& worker = isIsolated ? isolated : *workers[currentPool == this ? currentWorker : 0];
+
+        {
+            std::lock_guard lk(worker.mutex);
+            worker.tasks.push_back({ std::move(task), scope });
+        }
+        pendingTasks.fetch_add(1, std::memory_order_relaxed);
+
+        // Taking the lock prevents a worker from missing the wakeup
+        // between checking for tasks and going to sleep
+        { std::lock_guard lk(sleepMutex); }
+        sleepCondition.notify_one();
+    }
+
+    // Run a single task within the scope, from the caller's own deque
+    // if possible, otherwise stolen from another worker, and only then
+    // the oldest isolated task
+    // Returns false if no task could be found
+    bool runPending(const u64 scope = 0) {
+        const usize self = currentPool == this ? currentWorker : 0;
+        Task        task;
+
+        bool found = popTask(*workers[self], task, false, scope);
+        for (usize offset = 1; !found && offset < workers.size(); offset++)
+            found = popTask(*workers[(self + offset) % workers.size()], task, true, scope);
+        if (!found)
+            found = popTask(isolated, task, true, scope);
+
+        if (!found)
+            return false;
+
+        const u64 outerScope = currentScope;
+        currentScope         = task.scope;
+        task.run();
+        currentScope = outerScope;
+        return true;
+    }
+};
+
+// Tracks a set of tasks so the submitter can wait for all of them
+// Waiting threads keep running tasks of the group's scope, so nested
+// groups never deadlock. The group takes the scope of the thread that
+// creates it, an isolated task gets a new scope of its own
+class TaskGroup {
+    ThreadPool& pool;
+    u64         scope;
+    atomic<u64> pending;
+
+   public:
+    explicit TaskGroup(ThreadPool& pool) :
+        pool(pool),
+        scope(ThreadPool::scope()) {
+        pending = 0;
+    }
+
+    ~TaskGroup() { wait(); }
+
+    void run(std::function<void()> task, const bool isIsolated = false) {
+        pending.fetch_add(1, std::memory_order_relaxed);
+        pool.submit(
+            [this, task = std::move(task)]() {
+                task();
+                pending.fetch_sub(1, std::memory_order_release);
+            },
+            isIsolated ? pool.newScope() : scope, isIsolated);
+    }
+
+    void wait() {
+        while (pending.load(std::memory_order_acquire) > 0)
+            if (!pool.runPending(scope))
+                std::this_thread::yield();
+    }
+};
\ No newline at end of file
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "move.h"
+#include "types.h"
+#include "search.h"
+#include "tunable.h"
+#include "constants.h"
+
+#include <algorithm>
+
+// Root statistics the time manager reacts to
+struct RootStats {
+    Move bestMove;
+    Move mostVisited;
+    u64  bestVisits;
+    u64  secondVisits;
+    u64  totalVisits;
+    // Q of the best move and the best Q of any other move
+    float bestQ;
+    float secondQ;
+};
+
+// Splits the clock into a soft limit, which is scaled while the search
+// runs depending on how settled the root is, and a hard limit
+// that is never exceeded. A limit of 0 means there is none
+class TimeManager {
+    i64  softLimit;
+    i64  hardLimit;
+    bool fixedTime;
+
+    Move  lastBest;
+    float instability;
+    float scale;
+
+   public:
+    // The reason the soft limit is currently scaled
+    enum Decision {
+        NORMAL,
+        BEST_MOVE_FLIP,
+        CLOSE_VISITS,
+        DOMINANT_MOVE
+    };
+
+    Decision decision;
+
+    explicit TimeManager(const SearchLimits& limits) {
+        lastBest    = Move::null();
+        instability = 0;
+        scale       = 1;
+        decision    = NORMAL;
+        fixedTime   = limits.mtime != 0;
+
+        if (fixedTime) {
+            softLimit = limits.mtime;
+            hardLimit = limits.mtime;
+        }
+        else if (limits.time != 0 || limits.inc != 0) {
+            const i64 movesToGo = limits.movesToGo ? std::min<i64>(limits.movesToGo, DEFAULT_MOVES_TO_GO) : DEFAULT_MOVES_TO_GO;
+            const i64 available = std::max<i64>(limits.time - static_cast<i64>(MOVE_OVERHEAD), 1);
+            const i64 base      = limits.time / movesToGo + limits.inc / 2;
+
+            hardLimit = std::clamp<i64>(base * HARD_TIME_SCALE / 10'000, 1, available * MAX_TIME_FRACTION / 10'000);
+            softLimit = std::clamp<i64>(base * SOFT_TIME_SCALE / 10'000, 1, hardLimit);
+        }
+        else {
+            softLimit = 0;
+            hardLimit = 0;
+        }
+    }
+
+    bool enabled() const { return hardLimit != 0; }
+
+    i64 soft() const { return std::min(static_cast<i64>(softLimit * scale), hardLimit); }
+    i64 hard() const { return hardLimit; }
+
+    // Rescales the soft limit from the current root
+    // Returns true if the decision behind the scale changed
+    bool update(const RootStats& stats) {
+        // A fixed move time is spent in full
+        if (fixedTime)
+            return false;
+
+        instability *= INSTABILITY_DECAY / 10'000.0f;
+        if (!lastBest.isNull() && stats.bestMove != lastBest)
+            instability += 1;
+        lastBest = stats.bestMove;
+
+        const float share     = stats.totalVisits ? static_cast<float>(stats.bestVisits) / stats.totalVisits : 0;
+        const float closeness = stats.bestVisits ? static_cast<float>(stats.secondVisits) / stats.bestVisits : 0;
+
+        Decision newDecision = NORMAL;
+        scale                = 1;
+
+        if (instability >= 0.5f) {
+            scale *= 1 + std::min(instability, 2.0f) * INSTABILITY_SCALE / 10'000.0f;
+            newDecision = BEST_MOVE_FLIP;
+        }
+        if (closeness >= CLOSE_VISIT_RATIO / 10'000.0f) {
+            scale *= CLOSE_VISIT_EXTENSION / 10'000.0f;
+            if (newDecision == NORMAL)
+                newDecision = CLOSE_VISITS;
+        }
+        else if (newDecision == NORMAL && share >= DOMINANT_VISIT_SHARE / 10'000.0f) {
+            scale *= DOMINANT_VISIT_CUT / 10'000.0f;
+            newDecision = DOMINANT_MOVE;
+        }
+
+        const bool changed = newDecision != decision;
+        decision           = newDecision;
+        return changed;
+    }
+
+    bool shouldStop(const i64 elapsed) const { return enabled() && elapsed >= soft(); }
+
+    static string decisionName(const Decision decision) {
+        switch (decision) {
+        case BEST_MOVE_FLIP:
+            return "bestmove-flip";
+        case CLOSE_VISITS:
+            return "close-visits";
+        case DOMINANT_MOVE:
+            return "dominant-move";
+        default:
+            return "normal";
+        }
+    }
+};
\ No newline at end of file
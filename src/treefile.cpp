@@ -0,0 +1,212 @@
+#include "searcher.h"
+
+#include "mappedfile.h"
+
+#include <bit>
+#include <cstring>
+#include <fstream>
+
+// Saved trees are the part of the active half reachable from the root,
+// written breadth first so every node's children stay contiguous,
+// followed by the occupied TT entries. Child indices are positions in
+// the file, so a loaded tree is placed at the start of a half as is
+namespace {
+constexpr array<char, 8> TREE_MAGIC   = { 'C', 'H', 'A', 'O', 'S', 'T', 'R', 'E' };
+constexpr u32            TREE_VERSION = 1;
+
+struct TreeFileHeader {
+    array<char, 8> magic;
+    u32            version;
+    u32            fenLength;
+    u64            rootKey;
+    u64            nodeCount;
+    u64            ttEntries;
+};
+
+struct SavedNode {
+    i64   totalScore;
+    u64   visits;
+    u32   firstChild;
+    float policy;
+    float giniImpurity;
+    u16   move;
+    u16   state;
+    u8    numChildren;
+    u8    numMoves;
+    u8    pvChild;
+    u8    padding;
+};
+
+struct SavedEntry {
+    u64   key;
+    u64   visits;
+    float q;
+    u32   padding;
+};
+
+static_assert(sizeof(TreeFileHeader) == 40);
+static_assert(sizeof(SavedNode) == 40);
+static_assert(sizeof(SavedEntry) == 24);
+
+// The FEN is padded so the records after it stay aligned
+usize paddedFenLength(const usize length) { return (length + 7) / 8 * 8; }
+}
+
+template<typename Concurrency>
+bool BasicSearcher<Concurrency>::saveTree(const string& path) {
+    if (!canReuseTree || tree.root().visits == 0) {
+        cout << "info string no tree to save" << endl;
+        return false;
+    }
+
+    // Breadth first order of the reachable nodes, with where each node's children start
+    vector<const Node*> order      = { &tree.root() };
+    vector<u32>         childStart = { 0 };
+    for (usize idx = 0; idx < order.size(); idx++) {
+        const Node& node = *order[idx];
+        if (node.numChildren == 0 || node.firstChild.load().half() != tree.activeHalf()) {
+            childStart[idx] = 0;
+            continue;
+        }
+
+        childStart[idx]   = order.size();
+        const Node* child = &tree[node.firstChild.load()];
+        for (usize i = 0; i < node.numChildren; i++) {
+            order.push_back(child + i);
+            childStart.push_back(0);
+        }
+    }
+
+    u64 ttEntries = 0;
+    for (u64 idx = 0; idx < tree.tt.size; idx++)
+        ttEntries += tree.tt.entryAt(idx).key != 0;
+
+    const string fen = lastRoot.fen();
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        cout << "info string could not open " << path << endl;
+        return false;
+    }
+
+    const TreeFileHeader header{ TREE_MAGIC, TREE_VERSION, static_cast<u32>(fen.size()), lastRoot.zobrist, order.size(), ttEntries };
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    string paddedFen = fen;
+    paddedFen.resize(paddedFenLength(fen.size()), '\0');
+    file.write(paddedFen.data(), paddedFen.size());
+
+    for (usize idx = 0; idx < order.size(); idx++) {
+        const Node& node  = *order[idx];
+        const bool  inner = childStart[idx] != 0;
+
+        const SavedNode saved{ node.totalScore.load(),
+                               node.visits.load(),
+                               childStart[idx],
+                               node.policy.load(),
+                               node.giniImpurity.load(),
+                               std::bit_cast<u16>(node.move.load()),
+                               std::bit_cast<u16>(node.state.load()),
+                               static_cast<u8>(inner ? node.numChildren.load() : 0),
+                               node.numMoves.load(),
+                               static_cast<u8>(inner ? node.pvChild.load() : 0),
+                               0 };
+        file.write(reinterpret_cast<const char*>(&saved), sizeof(saved));
+    }
+
+    for (u64 idx = 0; idx < tree.tt.size; idx++) {
+        const HashTableEntry& entry = tree.tt.entryAt(idx);
+        if (entry.key == 0)
+            continue;
+        const SavedEntry saved{ entry.key, entry.visits, entry.q, 0 };
+        file.write(reinterpret_cast<const char*>(&saved), sizeof(saved));
+    }
+
+    if (!file) {
+        cout << "info string failed writing " << path << endl;
+        return false;
+    }
+
+    cout << "info string saved " << order.size() << " nodes and " << ttEntries << " tt entries" << endl;
+    return true;
+}
+
+template<typename Concurrency>
+bool BasicSearcher<Concurrency>::loadTree(const string& path) {
+    MappedFile file;
+    if (!file.open(path) || file.size() < sizeof(TreeFileHeader)) {
+        cout << "info string could not read " << path << endl;
+        return false;
+    }
+
+    TreeFileHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (header.magic != TREE_MAGIC || header.version != TREE_VERSION) {
+        cout << "info string " << path << " is not a version " << TREE_VERSION << " tree file" << endl;
+        return false;
+    }
+
+    const usize nodesOffset = sizeof(header) + paddedFenLength(header.fenLength);
+    const usize ttOffset    = nodesOffset + header.nodeCount * sizeof(SavedNode);
+    if (header.nodeCount == 0 || file.size() != ttOffset + header.ttEntries * sizeof(SavedEntry)) {
+        cout << "info string " << path << " is truncated" << endl;
+        return false;
+    }
+
+    if (header.nodeCount >= tree.activeTree().size()) {
+        cout << "info string " << path << " needs " << header.nodeCount << " nodes but the hash holds " << tree.activeTree().size() << endl;
+        return false;
+    }
+
+    Board root;
+    root.loadFromFEN(string(file.data() + sizeof(header), header.fenLength));
+    if (root.zobrist != header.rootKey) {
+        cout << "info string " << path << " has a mismatched root" << endl;
+        return false;
+    }
+
+    tree.reset();
+
+    const SavedNode* saved = reinterpret_cast<const SavedNode*>(file.data() + nodesOffset);
+    vector<Node>&    nodes = tree.activeTree();
+    for (u64 idx = 0; idx < header.nodeCount; idx++) {
+        const SavedNode& s    = saved[idx];
+        Node&            node = nodes[idx];
+
+        node.totalScore   = s.totalScore;
+        node.visits       = s.visits;
+        node.firstChild   = { s.firstChild, tree.activeHalf() };
+        node.policy       = s.policy;
+        node.giniImpurity = s.giniImpurity;
+        node.move         = std::bit_cast<Move>(s.move);
+        node.state        = std::bit_cast<GameState>(s.state);
+        node.numChildren  = s.numChildren;
+        node.numMoves     = s.numMoves;
+        node.pvChild      = s.pvChild;
+
+        // A child block pointing outside the file would leave the half
+        if (s.numChildren > 0 && s.firstChild + s.numChildren > header.nodeCount) {
+            tree.reset();
+            cout << "info string " << path << " is corrupt" << endl;
+            return false;
+        }
+    }
+
+    for (u64 idx = 0; idx < header.nodeCount; idx++)
+        tree.syncLanes(nodes[idx]);
+
+    const SavedEntry* entries = reinterpret_cast<const SavedEntry*>(file.data() + ttOffset);
+    for (u64 idx = 0; idx < header.ttEntries; idx++)
+        tree.tt.update(entries[idx].key, entries[idx].visits, entries[idx].q);
+
+    // The next search of this position, or one within reuse
+    // distance of it, continues from the loaded tree
+    lastRoot     = root;
+    canReuseTree = true;
+
+    cout << "info string loaded " << header.nodeCount << " nodes and " << header.ttEntries << " tt entries" << endl;
+    return true;
+}
+
+template bool BasicSearcher<SingleThreaded>::saveTree(const string&);
+template bool BasicSearcher<SingleThreaded>::loadTree(const string&);
\ No newline at end of file
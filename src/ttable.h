@@ -81,6 +81,7 @@ class TranspositionTable {
     void prefetch(const u64 key) const { __builtin_prefetch(&this->getEntry(key)); }
 
     HashTableEntry& getEntry(const u64 key) const { return table[index(key)]; }
+    HashTableEntry& entryAt(const u64 idx) const { return table[idx]; }
 
     void update(const u64 key, const u64 visits, const double q) {
         HashTableEntry& entry = getEntry(key);
@@ -88,6 +89,18 @@ class TranspositionTable {
             entry = HashTableEntry(key, visits, q);
     }
 
+    // In graph search every visit to a position, through any move order,
+    // is accumulated into its entry. Entries are always replaced, the
+    // positions near the root are rewritten on nearly every iteration
+    void accumulate(const u64 key, const float score) {
+        HashTableEntry& entry = getEntry(key);
+        if (key != entry.key)
+            entry = HashTableEntry(key, 0, 0);
+
+        entry.visits++;
+        entry.q += (score - entry.q) / entry.visits;
+    }
+
     float hashfull() const {
         const usize samples = std::min<u64>(1000, size);
         usize       hits    = 0;
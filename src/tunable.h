@@ -77,6 +77,9 @@ Tunable(CPUCT_VISIT_SCALE, 8172);
 
 Tunable(FPU_SHARPNESS_MARGIN, 500);
 
+Tunable(WIDENING_BASE, 4);
+Tunable(WIDENING_SCALE, 20000);
+
 Tunable(POLICY_MATERIAL_PHASE_DIVISOR, 4356);
 
 Tunable(BUTTERFLY_BONUS_DIVISOR, 8763);
@@ -91,4 +94,16 @@ Tunable(PAWN_VALUE, 100);
 Tunable(KNIGHT_VALUE, 310);
 Tunable(BISHOP_VALUE, 345);
 Tunable(ROOK_VALUE, 516);
-Tunable(QUEEN_VALUE, 917);  
\ No newline at end of file
+Tunable(QUEEN_VALUE, 917);
+
+// Time management
+Tunable(SOFT_TIME_SCALE, 7000);
+Tunable(HARD_TIME_SCALE, 30000);
+Tunable(MAX_TIME_FRACTION, 7500);
+Tunable(INSTABILITY_DECAY, 9500);
+Tunable(INSTABILITY_SCALE, 5000);
+Tunable(CLOSE_VISIT_RATIO, 8000);
+Tunable(CLOSE_VISIT_EXTENSION, 13000);
+Tunable(DOMINANT_VISIT_SHARE, 8000);
+Tunable(DOMINANT_VISIT_CUT, 5000);
+Tunable(EARLY_STOP_Q_MARGIN, 300);
\ No newline at end of file
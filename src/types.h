@@ -79,7 +79,8 @@ enum Activations {
 enum SearchMode {
     POLICY_ONLY,
     VALUE_ONLY,
-    FULL_SEARCH
+    FULL_SEARCH,
+    PROOF_NUMBER
 };
 
 constexpr array<std::string_view, 4> GAME_STATE_STR = { "ONGOING", "LOSS", "DRAW", "WIN" };
@@ -253,6 +254,23 @@ class RelaxedAtomic {
     }
 };
 
+// Concurrency policies of the search statistics. A tree and history searched by one
+// thread add with a plain load and store, shared ones need atomic read-modify-writes
+// Either way the values stay atomic, so other threads can read them while they change
+struct SingleThreaded {
+    template<typename T>
+    static void add(RelaxedAtomic<T>& value, const std::type_identity_t<T> delta) {
+        value.store(value.load() + delta);
+    }
+};
+
+struct MultiThreaded {
+    template<typename T>
+    static void add(RelaxedAtomic<T>& value, const std::type_identity_t<T> delta) {
+        value.getUnderlying().fetch_add(delta, std::memory_order_relaxed);
+    }
+};
+
 namespace internal {
     template <typename T, usize kN, usize... kNs>
     struct MultiArrayImpl {